@@ -0,0 +1,106 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QDir>
+#include <QFile>
+#include <QLocale>
+#include <QObject>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThreadPool>
+
+#include "kcolorschememodel.h"
+
+// Makes QStandardPaths find data in dir only, for as long as it lives
+class DataDirsOverride
+{
+public:
+    explicit DataDirsOverride(const QString &dir)
+        : m_wasSet(qEnvironmentVariableIsSet("XDG_DATA_DIRS"))
+        , m_dataDirs(qgetenv("XDG_DATA_DIRS"))
+    {
+        qputenv("XDG_DATA_DIRS", QFile::encodeName(dir));
+    }
+    ~DataDirsOverride()
+    {
+        if (m_wasSet) {
+            qputenv("XDG_DATA_DIRS", m_dataDirs);
+        } else {
+            qunsetenv("XDG_DATA_DIRS");
+        }
+    }
+
+private:
+    const bool m_wasSet;
+    const QByteArray m_dataDirs;
+};
+
+// Scans thousands of scheme files, so it is not run along with the tests
+class KColorSchemeModelBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QStandardPaths::setTestModeEnabled(true);
+
+        QVERIFY(m_schemes.isValid());
+        QVERIFY(QDir(m_schemes.path()).mkpath(QStringLiteral("color-schemes")));
+        QFile source(QStringLiteral(":/org.kde.kcolorscheme/color-schemes/BreezeLight.colors"));
+        QVERIFY(source.open(QIODevice::ReadOnly));
+        const QByteArray contents = source.readAll();
+        for (int i = 0; i < 5000; ++i) {
+            QFile file(m_schemes.filePath(QStringLiteral("color-schemes/Synthetic%1.colors").arg(i)));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write(contents);
+        }
+    }
+
+    void benchModel()
+    {
+        const DataDirsOverride dataDirs(m_schemes.path());
+        QBENCHMARK {
+            KColorSchemeModel model;
+        }
+    }
+
+    void benchColdScan_data()
+    {
+        QTest::addColumn<int>("threads");
+
+        QTest::newRow("1 thread") << 1;
+        QTest::newRow("2 threads") << 2;
+        QTest::newRow("4 threads") << 4;
+        QTest::newRow("8 threads") << 8;
+    }
+
+    void benchColdScan()
+    {
+        QFETCH(int, threads);
+        QThreadPool *pool = QThreadPool::globalInstance();
+        const int maxThreadCount = pool->maxThreadCount();
+        pool->setMaxThreadCount(threads);
+        const DataDirsOverride dataDirs(m_schemes.path());
+        // Without the index every file is read again
+        const QString index = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kcolorscheme/schemes_")
+            + QLocale().name() + QStringLiteral(".index");
+        QBENCHMARK {
+            QFile::remove(index);
+            KColorSchemeModel model;
+        }
+        pool->setMaxThreadCount(maxThreadCount);
+    }
+
+private:
+    QTemporaryDir m_schemes;
+};
+
+QTEST_MAIN(KColorSchemeModelBenchmark)
+
+#include "kcolorschememodelbenchmark.moc"
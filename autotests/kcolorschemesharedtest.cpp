@@ -0,0 +1,113 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <KConfig>
+#include <KConfigGroup>
+#include <KSharedConfig>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QObject>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "kcolorscheme.h"
+
+// Sharing is decided once per process, and the application resolves its scheme as
+// soon as it is created, so the environment has to be in place before that
+static void initEnvironment()
+{
+    // Share resolved schemes through a runtime dir of our own
+    static QTemporaryDir runtimeDir;
+    qputenv("XDG_RUNTIME_DIR", QFile::encodeName(runtimeDir.path()));
+    qputenv("KCOLORSCHEME_SHARED_CACHE", "1");
+    QStandardPaths::setTestModeEnabled(true);
+}
+Q_CONSTRUCTOR_FUNCTION(initEnvironment)
+
+class KColorSchemeSharedTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init()
+    {
+        QVERIFY(m_dir.isValid());
+        m_file = m_dir.filePath(QStringLiteral("shared.colors"));
+        QFile::remove(m_file);
+        QVERIFY(QFile::copy(QFINDTESTDATA("kcolorschemetest.colors"), m_file));
+        QVERIFY(QFile::setPermissions(m_file, QFile::ReadOwner | QFile::WriteOwner));
+        // Files changed just now are not shared, their contents may still change unnoticed
+        setModified(QDateTime::currentDateTime().addSecs(-3600));
+    }
+
+    void sharedSchemes()
+    {
+        const auto config = KSharedConfig::openConfig(m_file, KConfig::SimpleConfig);
+        config->reparseConfiguration();
+        const QPalette expected = KColorScheme::createApplicationPalette(config);
+        const KColorScheme expectedScheme(QPalette::Disabled, KColorScheme::Selection, config);
+        QVERIFY(QFile::exists(sharedFile()));
+
+        // Resolved from the shared file now
+        QCOMPARE(KColorScheme::createApplicationPalette(config), expected);
+        QCOMPARE(KColorScheme(QPalette::Disabled, KColorScheme::Selection, config), expectedScheme);
+        QCOMPARE(KColorScheme(QPalette::Disabled, KColorScheme::Selection, config).decoration(KColorScheme::HoverColor),
+                 expectedScheme.decoration(KColorScheme::HoverColor));
+
+        // A corrupt shared file is ignored
+        {
+            QFile corrupt(sharedFile());
+            QVERIFY(corrupt.open(QIODevice::ReadWrite));
+            QVERIFY(corrupt.seek(corrupt.size() - 8));
+            corrupt.write("garbage!");
+        }
+        QCOMPARE(KColorScheme::createApplicationPalette(config), expected);
+    }
+
+    void staleConfig()
+    {
+        const auto stale = KSharedConfig::openConfig(m_file, KConfig::SimpleConfig);
+        stale->reparseConfiguration();
+        KColorScheme(QPalette::Active, KColorScheme::View, stale).background();
+        QVERIFY(QFile::exists(sharedFile()));
+
+        // A config read before its file changed doesn't get its old colors published under the new stamps
+        {
+            KConfig config(m_file, KConfig::SimpleConfig);
+            KConfigGroup(&config, QStringLiteral("Colors:View")).writeEntry("BackgroundNormal", QColor(4, 5, 6));
+        }
+        setModified(QDateTime::currentDateTime().addSecs(-1800));
+        KColorScheme(QPalette::Active, KColorScheme::View, stale).background();
+
+        const auto other = KSharedConfig::openConfig(m_file, KConfig::CascadeConfig);
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::View, other).background().color(), QColor(4, 5, 6));
+    }
+
+private:
+    void setModified(const QDateTime &modified)
+    {
+        QFile source(m_file);
+        QVERIFY(source.open(QIODevice::ReadWrite));
+        QVERIFY(source.setFileTime(modified, QFileDevice::FileModificationTime));
+    }
+
+    QString sharedFile() const
+    {
+        return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + QStringLiteral("/kcolorscheme/")
+            + QString::fromLatin1(QCryptographicHash::hash(m_file.toUtf8(), QCryptographicHash::Sha1).toHex()) + QStringLiteral(".kcsr");
+    }
+
+    QTemporaryDir m_dir;
+    QString m_file;
+};
+
+QTEST_MAIN(KColorSchemeSharedTest)
+
+#include "kcolorschemesharedtest.moc"
@@ -4,18 +4,96 @@
     SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
 */
 
+#include <KConfig>
+#include <KConfigGroup>
+#include <KSharedConfig>
+
 #include <QAbstractItemModel>
+#include <QDateTime>
+#include <QDir>
+#include <QHash>
+#include <QIcon>
+#include <QImage>
+#include <QLocale>
 #include <QObject>
+#include <QSaveFile>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTemporaryDir>
 #include <QTest>
+#include <QThread>
+
+#ifdef Q_OS_UNIX
+#include <sys/time.h>
+#endif
+
+#include <atomic>
+#include <memory>
+#include <vector>
 
 #include "kcolorscheme.h"
 #include "kcolorschememanager.h"
+#include "kcolorschememodel.h"
+#include "kcolorschemesnapshot.h"
+#include "kstatefulbrush.h"
+
+// Makes QStandardPaths find data in dir only, for as long as it lives
+class DataDirsOverride
+{
+public:
+    explicit DataDirsOverride(const QString &dir)
+        : m_wasSet(qEnvironmentVariableIsSet("XDG_DATA_DIRS"))
+        , m_dataDirs(qgetenv("XDG_DATA_DIRS"))
+    {
+        qputenv("XDG_DATA_DIRS", QFile::encodeName(dir));
+    }
+    ~DataDirsOverride()
+    {
+        if (m_wasSet) {
+            qputenv("XDG_DATA_DIRS", m_dataDirs);
+        } else {
+            qunsetenv("XDG_DATA_DIRS");
+        }
+    }
+
+private:
+    const bool m_wasSet;
+    const QByteArray m_dataDirs;
+};
+
+// The row of the scheme with the given id, -1 if the model has none
+static int rowOf(const QAbstractItemModel &model, const QString &id)
+{
+    for (int row = 0; row < model.rowCount(); ++row) {
+        if (model.index(row, 0).data(KColorSchemeModel::IdRole).toString() == id) {
+            return row;
+        }
+    }
+    return -1;
+}
+
+// The preview of index, once it got rendered in place of the blank placeholder
+static QIcon renderedPreview(const QModelIndex &index)
+{
+    const auto preview = [&index] {
+        return index.data(KColorSchemeModel::IconRole).value<QIcon>();
+    };
+    QTest::qWaitFor([&preview] {
+        return preview().pixmap(16).toImage().pixelColor(0, 0).alpha() != 0;
+    });
+    return preview();
+}
 
 class KColorSchemeTest : public QObject
 {
     Q_OBJECT
 
 private Q_SLOTS:
+    void initTestCase()
+    {
+        QStandardPaths::setTestModeEnabled(true);
+    }
+
     void benchConstruction_data()
     {
         KColorSchemeManager manager;
@@ -41,6 +119,65 @@ private Q_SLOTS:
             KColorScheme scheme(QPalette::Active);
         }
     }
+
+    void benchResolve()
+    {
+        // Resolves every set and state of the scheme anew, like activating a scheme does
+        const auto config = KSharedConfig::openConfig(QFINDTESTDATA("kcolorschemetest.colors"), KConfig::SimpleConfig);
+        QBENCHMARK {
+            KColorScheme::createApplicationPalette(config);
+        }
+    }
+
+    void benchAccessors()
+    {
+        // What styles do on every paint
+        const KColorScheme scheme(QPalette::Active, KColorScheme::View);
+        QBENCHMARK {
+            for (int role = 0; role < KColorScheme::NBackgroundRoles; ++role) {
+                scheme.background(static_cast<KColorScheme::BackgroundRole>(role));
+            }
+            for (int role = 0; role < KColorScheme::NForegroundRoles; ++role) {
+                scheme.foreground(static_cast<KColorScheme::ForegroundRole>(role));
+            }
+        }
+    }
+
+    void benchContrast_data()
+    {
+        QTest::addColumn<bool>("explicitConfig");
+
+        QTest::newRow("default") << false;
+        QTest::newRow("explicit") << true;
+    }
+
+    void benchContrast()
+    {
+        // Styles ask for the contrast on every paint, some of them with the config of their scheme
+        QFETCH(bool, explicitConfig);
+        const auto config = explicitConfig ? KSharedConfig::openConfig(QFINDTESTDATA("kcolorschemetest.colors"), KConfig::SimpleConfig) : KSharedConfigPtr();
+        QBENCHMARK {
+            KColorScheme::contrastF(config);
+            KColorScheme::frameContrast(config);
+        }
+    }
+
+    void benchStatefulBrush_data()
+    {
+        benchContrast_data();
+    }
+
+    void benchStatefulBrush()
+    {
+        // Widgets build these for their roles, the effects of each state come from the cache
+        QFETCH(bool, explicitConfig);
+        const auto config = explicitConfig ? KSharedConfig::openConfig(QFINDTESTDATA("kcolorschemetest.colors"), KConfig::SimpleConfig) : KSharedConfigPtr();
+        QBENCHMARK {
+            KStatefulBrush(KColorScheme::View, KColorScheme::NormalBackground, config);
+            KStatefulBrush(QBrush(Qt::red), config);
+        }
+    }
+
     void readColors_data()
     {
         QTest::addColumn<int>("colorSet");
@@ -95,6 +232,695 @@ private Q_SLOTS:
     {
         auto file = QFINDTESTDATA("kcolorschemetest.colors");
         QCOMPARE(KColorScheme::contrastF(KSharedConfig::openConfig(file, KConfig::SimpleConfig)), 0.5);
+        QCOMPARE(KColorScheme::frameContrast(KSharedConfig::openConfig(file, KConfig::SimpleConfig)), 0.2);
+
+        // The application's contrast follows the scheme in use
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", file);
+        QCOMPARE(KColorScheme::contrastF(), 0.5);
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", QStringLiteral(":/org.kde.kcolorscheme/color-schemes/BreezeDark.colors"));
+        QCOMPARE(KColorScheme::contrastF(), 0.4);
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", QVariant());
+    }
+
+    void malformedColors()
+    {
+        // A malformed entry gets the default of the set like a missing one, the Header one falls back to Window
+        QTemporaryDir dir;
+        const auto writeScheme = [&dir](const QString &name, const QString &entry) {
+            KConfig config(dir.filePath(name), KConfig::SimpleConfig);
+            KConfigGroup(&config, QStringLiteral("Colors:Window")).writeEntry("BackgroundNormal", QColor(1, 2, 3));
+            if (!entry.isNull()) {
+                KConfigGroup(&config, QStringLiteral("Colors:View")).writeEntry("BackgroundNormal", entry);
+                KConfigGroup(&config, QStringLiteral("Colors:Header")).writeEntry("BackgroundNormal", entry);
+            }
+            return KSharedConfig::openConfig(dir.filePath(name), KConfig::SimpleConfig);
+        };
+        const auto missing = writeScheme(QStringLiteral("missing.colors"), QString());
+        const auto malformed = writeScheme(QStringLiteral("malformed.colors"), QStringLiteral("12,34"));
+
+        for (const auto set : {KColorScheme::View, KColorScheme::Header}) {
+            QCOMPARE(KColorScheme(QPalette::Active, set, malformed).background().color(),
+                     KColorScheme(QPalette::Active, set, missing).background().color());
+        }
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::Header, malformed).background().color(), QColor(1, 2, 3));
+    }
+
+    void shades()
+    {
+        auto config = KSharedConfig::openConfig(QFINDTESTDATA("kcolorschemetest.colors"), KConfig::SimpleConfig);
+        const KColorScheme scheme(QPalette::Active, KColorScheme::Window, config);
+        for (int role = 0; role < KColorScheme::NShadeRoles; ++role) {
+            const auto shadeRole = KColorScheme::ShadeRole(role);
+            QCOMPARE(scheme.shade(shadeRole), KColorScheme::shade(scheme.background().color(), shadeRole, KColorScheme::contrastF(config)));
+        }
+
+        const QPalette palette = KColorScheme::createApplicationPalette(config);
+        QCOMPARE(palette.color(QPalette::Active, QPalette::Mid), scheme.shade(KColorScheme::MidShade));
+        QCOMPARE(palette.color(QPalette::Disabled, QPalette::Shadow), KColorScheme(QPalette::Disabled, KColorScheme::Window, config).shade(KColorScheme::ShadowShade));
+    }
+
+    void batchShades()
+    {
+        // Cover very dark, very light and everything in between
+        QList<QColor> colors;
+        for (int value = 0; value < 256; value += 5) {
+            colors << QColor(value, value, value) << QColor(value, 255 - value, value / 2);
+        }
+
+        for (const qreal contrast : {0.0, 0.3, 0.7, 1.0}) {
+            for (const QColor &color : std::as_const(colors)) {
+                const auto shades = KColorScheme::shades(color, contrast, 0.2);
+                for (int role = 0; role < KColorScheme::NShadeRoles; ++role) {
+                    QCOMPARE(shades[role], KColorScheme::shade(color, KColorScheme::ShadeRole(role), contrast, 0.2));
+                }
+            }
+
+            for (int role = 0; role < KColorScheme::NShadeRoles; ++role) {
+                QList<QColor> shaded(colors.size());
+                KColorScheme::shade(colors, shaded, KColorScheme::ShadeRole(role), contrast);
+                for (qsizetype i = 0; i < colors.size(); ++i) {
+                    QCOMPARE(shaded[i], KColorScheme::shade(colors[i], KColorScheme::ShadeRole(role), contrast));
+                }
+            }
+        }
+    }
+
+    void statefulBrushEffects()
+    {
+        auto config = KSharedConfig::openConfig(QFINDTESTDATA("kcolorschemetest.colors"), KConfig::SimpleConfig);
+        const QBrush background = KColorScheme(QPalette::Active, KColorScheme::View, config).background();
+        const QBrush foreground = KColorScheme(QPalette::Active, KColorScheme::View, config).foreground();
+
+        // Building many brushes must keep giving the same results as the scheme itself
+        for (int i = 0; i < 3; ++i) {
+            const KStatefulBrush statefulBackground(background, config);
+            QCOMPARE(statefulBackground.brush(QPalette::Disabled).color(), KColorScheme(QPalette::Disabled, KColorScheme::View, config).background().color());
+            QCOMPARE(statefulBackground.brush(QPalette::Inactive).color(), background.color());
+
+            const KStatefulBrush statefulForeground(foreground, background, config);
+            QCOMPARE(statefulForeground.brush(QPalette::Disabled).color(),
+                     KColorScheme(QPalette::Disabled, KColorScheme::View, config).foreground().color());
+        }
+
+        // Applying the effects to many colors at once gives the same results as one brush each
+        QList<QColor> colors;
+        for (int role = 0; role < KColorScheme::NForegroundRoles; ++role) {
+            colors << KColorScheme(QPalette::Active, KColorScheme::View, config).foreground(KColorScheme::ForegroundRole(role)).color();
+        }
+        for (const auto state : {QPalette::Active, QPalette::Inactive, QPalette::Disabled}) {
+            QList<QColor> changed = colors;
+            KColorScheme::applyStateEffects(changed, state, background.color(), config);
+            for (qsizetype i = 0; i < colors.size(); ++i) {
+                QCOMPARE(changed[i], KStatefulBrush(colors[i], background, config).brush(state).color());
+            }
+        }
+    }
+
+    void followSchemeChanges()
+    {
+        const auto file = QFINDTESTDATA("kcolorschemetest.colors");
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", file);
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::View).background().color(), QColor(KColorScheme::View, KColorScheme::NormalBackground, QPalette::Active));
+
+        const quint64 generation = KColorScheme::generation();
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", QStringLiteral(":/org.kde.kcolorscheme/color-schemes/BreezeDark.colors"));
+        QVERIFY(KColorScheme::generation() != generation);
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::View).background().color(), QColor(20, 22, 24));
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", QVariant());
+
+        // Unsaved changes to a config must show up right away
+        KSharedConfigPtr config = KSharedConfig::openConfig(file, KConfig::SimpleConfig);
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::Window, config).background().color(),
+                 QColor(KColorScheme::Window, KColorScheme::NormalBackground, QPalette::Active));
+        KConfigGroup group(config, QStringLiteral("Colors:Window"));
+        group.writeEntry("BackgroundNormal", QColor(1, 2, 3));
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::Window, config).background().color(), QColor(1, 2, 3));
+        // Don't write the change back to the test data
+        config->markAsClean();
+    }
+
+    void followConfigChanges()
+    {
+        QTemporaryDir dir;
+        const QString file = dir.filePath(QStringLiteral("changing.colors"));
+        QVERIFY(QFile::copy(QFINDTESTDATA("kcolorschemetest.colors"), file));
+        QVERIFY(QFile::setPermissions(file, QFile::ReadOwner | QFile::WriteOwner));
+        const auto windowBackground = [](const KSharedConfigPtr &config) {
+            return KColorScheme(QPalette::Active, KColorScheme::Window, config).background().color();
+        };
+
+        // Changes written and synced show up once the files of the config are checked again
+        const KSharedConfigPtr config = KSharedConfig::openConfig(file, KConfig::SimpleConfig);
+        QCOMPARE(windowBackground(config), QColor(KColorScheme::Window, KColorScheme::NormalBackground, QPalette::Active));
+        KConfigGroup(config, QStringLiteral("Colors:Window")).writeEntry("BackgroundNormal", QColor(1, 2, 3));
+        QVERIFY(config->sync());
+        QTRY_COMPARE(windowBackground(config), QColor(1, 2, 3));
+        QCOMPARE(windowBackground(config), QColor(1, 2, 3));
+
+        // So do changes of others, once the config is reparsed
+        {
+            KConfig other(file, KConfig::SimpleConfig);
+            KConfigGroup(&other, QStringLiteral("Colors:Window")).writeEntry("BackgroundNormal", QColor(100, 110, 120));
+        }
+        config->reparseConfiguration();
+        QTRY_COMPARE(windowBackground(config), QColor(100, 110, 120));
+        QCOMPARE(windowBackground(config), QColor(100, 110, 120));
+
+        // Reapplying a scheme that isn't the application's doesn't affect the application's
+        const auto snapshot = KColorSchemeSnapshot::current();
+        const quint64 generation = KColorScheme::generation();
+        QCOMPARE(KColorScheme::createApplicationPalette(config).color(QPalette::Active, QPalette::Window), QColor(100, 110, 120));
+        QCOMPARE(KColorScheme::generation(), generation);
+        QVERIFY(snapshot.isCurrent());
+
+        // Once settled, the config is cached again: a change hidden from the cache by
+        // marking it clean doesn't show, as long as the files stay the same
+        QTest::qWait(2500);
+        QCOMPARE(windowBackground(config), QColor(100, 110, 120));
+        KConfigGroup(config, QStringLiteral("Colors:Window")).writeEntry("BackgroundNormal", QColor(5, 6, 7));
+        config->markAsClean();
+        QCOMPARE(windowBackground(config), QColor(100, 110, 120));
+    }
+
+    void concurrentConstruction()
+    {
+        // Render threads construct schemes while the GUI thread switches between two
+        const auto file = QFINDTESTDATA("kcolorschemetest.colors");
+        const auto darkFile = QStringLiteral(":/org.kde.kcolorscheme/color-schemes/BreezeDark.colors");
+        const QColor background(KColorScheme::View, KColorScheme::NormalBackground, QPalette::Active);
+        const QColor darkBackground(20, 22, 24);
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", file);
+
+        std::atomic<bool> done = false;
+        std::atomic<int> unexpected = 0;
+        std::vector<std::unique_ptr<QThread>> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back(QThread::create([&] {
+                do {
+                    for (int state = QPalette::Active; state < QPalette::NColorGroups; ++state) {
+                        for (int set = KColorScheme::View; set < KColorScheme::NColorSets; ++set) {
+                            const KColorScheme scheme(static_cast<QPalette::ColorGroup>(state), static_cast<KColorScheme::ColorSet>(set));
+                            // Also computes the lazily derived colors
+                            scheme.background(KColorScheme::PositiveBackground);
+                            scheme.decoration(KColorScheme::HoverColor);
+                        }
+                    }
+                    const QColor color = KColorScheme(QPalette::Active, KColorScheme::View).background().color();
+                    if (color != background && color != darkBackground) {
+                        ++unexpected;
+                    }
+                } while (!done);
+            }));
+            threads.back()->start();
+        }
+
+        for (int i = 0; i < 50; ++i) {
+            qApp->setProperty("KDE_COLOR_SCHEME_PATH", i % 2 ? file : darkFile);
+            KColorScheme(QPalette::Active, KColorScheme::View);
+        }
+        done = true;
+        for (const auto &thread : threads) {
+            QVERIFY(thread->wait());
+        }
+        QCOMPARE(unexpected, 0);
+
+        // Every thread sees the scheme the GUI thread switched to last
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::View).background().color(), background);
+        QColor fromThread;
+        std::unique_ptr<QThread> thread(QThread::create([&fromThread] {
+            fromThread = KColorScheme(QPalette::Active, KColorScheme::View).background().color();
+        }));
+        thread->start();
+        QVERIFY(thread->wait());
+        QCOMPARE(fromThread, background);
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", QVariant());
+    }
+
+    void snapshots()
+    {
+        const auto file = QFINDTESTDATA("kcolorschemetest.colors");
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", file);
+
+        // The GUI thread publishes a change right away, other threads take what it resolved
+        QColor fromThread;
+        bool currentInThread = false;
+        std::unique_ptr<QThread> thread(QThread::create([&fromThread, &currentInThread] {
+            const auto snapshot = KColorSchemeSnapshot::current();
+            currentInThread = snapshot.isCurrent();
+            fromThread = snapshot.scheme(QPalette::Active, KColorScheme::View).background().color();
+        }));
+        thread->start();
+        QVERIFY(thread->wait());
+        QVERIFY(currentInThread);
+        QCOMPARE(fromThread, QColor(KColorScheme::View, KColorScheme::NormalBackground, QPalette::Active));
+
+        const auto snapshot = KColorSchemeSnapshot::current();
+        QVERIFY(snapshot.isCurrent());
+        QCOMPARE(snapshot.scheme(QPalette::Disabled, KColorScheme::Selection), KColorScheme(QPalette::Disabled, KColorScheme::Selection));
+
+        // Activating a scheme publishes it at once, taken snapshots stay as they were
+        KColorSchemeManager manager;
+        manager.setAutosaveChanges(false);
+        const quint64 generation = KColorScheme::generation();
+        manager.activateSchemeId(QStringLiteral("BreezeDark"));
+        QVERIFY(!snapshot.isCurrent());
+        const auto dark = KColorSchemeSnapshot::current();
+        QVERIFY(dark.generation() > generation);
+        QCOMPARE(dark.scheme(QPalette::Active, KColorScheme::View).background().color(), QColor(20, 22, 24));
+        QCOMPARE(qApp->palette().color(QPalette::Active, QPalette::Base), QColor(20, 22, 24));
+        QCOMPARE(snapshot.scheme(QPalette::Active, KColorScheme::View).background().color(),
+                 QColor(KColorScheme::View, KColorScheme::NormalBackground, QPalette::Active));
+
+        // Announcing the scheme to the application doesn't invalidate what was published,
+        // nor does the platform theme applying a palette for it afterwards
+        QVERIFY(dark.isCurrent());
+        QEvent paletteChange(QEvent::ApplicationPaletteChange);
+        QCoreApplication::sendEvent(qApp, &paletteChange);
+        QVERIFY(dark.isCurrent());
+        manager.activateSchemeId(QString());
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", QVariant());
+
+        // Nor does applying the palette made for the application's scheme
+        const QPalette palette = KColorScheme::createApplicationPalette(KSharedConfigPtr());
+        const auto system = KColorSchemeSnapshot::current();
+        qApp->setPalette(palette);
+        QVERIFY(system.isCurrent());
+        qApp->setPalette(QPalette());
+    }
+
+    void activateSchemeAsync()
+    {
+        KColorSchemeManager manager;
+        manager.setAutosaveChanges(false);
+        manager.activateSchemeId(QStringLiteral("BreezeLight"));
+
+        // The request being resolved gets activated, then only the latest of those made meanwhile
+        const auto resolving = manager.activateSchemeIdAsync(QStringLiteral("BreezeDark"));
+        const auto light = manager.activateSchemeIdAsync(QStringLiteral("BreezeLight"));
+        const auto dark = manager.activateSchemeIdAsync(QStringLiteral("BreezeDark"));
+        QTRY_VERIFY(dark.isFinished());
+        QVERIFY(!dark.isCanceled());
+        QVERIFY(resolving.isFinished());
+        QVERIFY(!resolving.isCanceled());
+        QVERIFY(light.isCanceled());
+        QCOMPARE(manager.activeSchemeId(), QStringLiteral("BreezeDark"));
+        QCOMPARE(qApp->palette().color(QPalette::Active, QPalette::Base), QColor(20, 22, 24));
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::View).background().color(), QColor(20, 22, 24));
+
+        // A synchronous activation supersedes pending requests
+        const auto pending = manager.activateSchemeIdAsync(QStringLiteral("BreezeDark"));
+        manager.activateSchemeId(QStringLiteral("BreezeLight"));
+        QTRY_VERIFY(pending.isFinished());
+        QVERIFY(pending.isCanceled());
+        QCOMPARE(manager.activeSchemeId(), QStringLiteral("BreezeLight"));
+        QCOMPARE(qApp->palette().color(QPalette::Active, QPalette::Base), QColor(255, 255, 255));
+
+        // Requests of a manager destroyed while they are resolved get canceled
+        auto orphaning = std::make_unique<KColorSchemeManager>();
+        orphaning->setAutosaveChanges(false);
+        const auto orphaned = orphaning->activateSchemeIdAsync(QStringLiteral("BreezeDark"));
+        orphaning.reset();
+        QTRY_VERIFY(orphaned.isFinished());
+        QVERIFY(orphaned.isCanceled());
+        QCOMPARE(qApp->palette().color(QPalette::Active, QPalette::Base), QColor(255, 255, 255));
+
+        manager.activateSchemeId(QString());
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", QVariant());
+    }
+
+    void watchUserSchemes()
+    {
+        const QString userDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QStringLiteral("/color-schemes");
+        if (QFileInfo::exists(userDir)) {
+            QSKIP("the user's color-schemes directory exists already");
+        }
+        QTemporaryDir dataDir;
+        const DataDirsOverride dataDirs(dataDir.path());
+        KColorSchemeModel model;
+        QVERIFY(rowOf(model, QStringLiteral("User")) < 0);
+        QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+
+        // The directory is noticed when it appears, along with the schemes in it
+        QVERIFY(QDir().mkpath(userDir));
+        QSaveFile file(userDir + QStringLiteral("/User.colors"));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("[General]\nName=User\n");
+        QVERIFY(file.commit());
+        QTRY_VERIFY(rowOf(model, QStringLiteral("User")) > 0);
+        QVERIFY(inserted.count() > 0);
+
+        QVERIFY(QDir(userDir).removeRecursively());
+        QTRY_VERIFY(rowOf(model, QStringLiteral("User")) < 0);
+    }
+
+    void schemeLookup()
+    {
+        QTemporaryDir dataDir;
+        const QString schemesDir = dataDir.filePath(QStringLiteral("color-schemes"));
+        QVERIFY(QDir().mkpath(schemesDir));
+        const auto writeScheme = [&schemesDir](const QString &id, const QByteArray &name) {
+            QSaveFile file(schemesDir + QLatin1Char('/') + id + QStringLiteral(".colors"));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write("[General]\nName=" + name + "\n");
+            QVERIFY(file.commit());
+        };
+        writeScheme(QStringLiteral("First"), "Shared Name");
+        writeScheme(QStringLiteral("Second"), "Shared Name");
+        writeScheme(QStringLiteral("Third"), "Third");
+
+        const DataDirsOverride dataDirs(dataDir.path());
+        KColorSchemeManager manager;
+        const QAbstractItemModel *model = manager.model();
+
+        QCOMPARE(manager.indexForSchemeId(QString()).row(), 0);
+        QCOMPARE(manager.indexForScheme(QString()).row(), 0);
+        QCOMPARE(manager.indexForSchemeId(QStringLiteral("Third")).row(), rowOf(*model, QStringLiteral("Third")));
+        QCOMPARE(manager.indexForScheme(QStringLiteral("Third")).row(), rowOf(*model, QStringLiteral("Third")));
+        QCOMPARE(manager.indexForScheme(QStringLiteral("Shared Name")).row(), rowOf(*model, QStringLiteral("First")));
+        QVERIFY(!manager.indexForSchemeId(QStringLiteral("Missing")).isValid());
+        QVERIFY(!manager.indexForScheme(QStringLiteral("Missing")).isValid());
+        // The default entry is only found by the empty string
+        QVERIFY(!manager.indexForScheme(model->index(0, 0).data(KColorSchemeModel::NameRole).toString()).isValid());
+
+        // Rows moving around are followed
+        QSignalSpy inserted(model, &QAbstractItemModel::rowsInserted);
+        writeScheme(QStringLiteral("Added"), "Added");
+        QTRY_COMPARE(inserted.count(), 1);
+        QCOMPARE(manager.indexForSchemeId(QStringLiteral("Added")).row(), rowOf(*model, QStringLiteral("Added")));
+        QCOMPARE(manager.indexForSchemeId(QStringLiteral("Third")).row(), rowOf(*model, QStringLiteral("Third")));
+
+        QSignalSpy removed(model, &QAbstractItemModel::rowsRemoved);
+        QVERIFY(QFile::remove(schemesDir + QStringLiteral("/First.colors")));
+        QTRY_COMPARE(removed.count(), 1);
+        QVERIFY(!manager.indexForSchemeId(QStringLiteral("First")).isValid());
+        QCOMPARE(manager.indexForScheme(QStringLiteral("Shared Name")).row(), rowOf(*model, QStringLiteral("Second")));
+    }
+
+    void schemeNames()
+    {
+        QTemporaryDir dataDir;
+        QVERIFY(QDir(dataDir.path()).mkpath(QStringLiteral("color-schemes")));
+        const auto writeScheme = [&dataDir](const QString &id, const QByteArray &general) {
+            QFile file(dataDir.filePath(QStringLiteral("color-schemes/%1.colors").arg(id)));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write("[Colors:View]\nBackgroundNormal=1,2,3\n\n" + general + "\n[KDE]\ncontrast=4\nName=Not the name\n");
+        };
+        writeScheme(QStringLiteral("Plain"), "[General]\nName=Plain Scheme\n");
+        writeScheme(QStringLiteral("Localized"), "[General]\nName=English\nName[de]=Deutsch\nName[de_AT]=\xc3\x96sterreichisch\nName[fr]=Fran\xc3\xa7\x61is\n");
+        writeScheme(QStringLiteral("Language"), "[General]\nName = English\nName[de]=Deutsch\n");
+        writeScheme(QStringLiteral("Escaped"), "[General]\nName=\\sLeading\\tTab\n");
+        writeScheme(QStringLiteral("Unnamed"), "[General]\nColorScheme=Unnamed\n");
+
+        QHash<QString, QString> names;
+        {
+            const QLocale defaultLocale;
+            QLocale::setDefault(QLocale(QStringLiteral("de_AT")));
+            const DataDirsOverride dataDirs(dataDir.path());
+            KColorSchemeModel model;
+            QLocale::setDefault(defaultLocale);
+            for (int row = 0; row < model.rowCount(); ++row) {
+                const QModelIndex index = model.index(row);
+                names.insert(index.data(KColorSchemeModel::IdRole).toString(), index.data(KColorSchemeModel::NameRole).toString());
+            }
+        }
+
+        QCOMPARE(names.value(QStringLiteral("Plain")), QStringLiteral("Plain Scheme"));
+        QCOMPARE(names.value(QStringLiteral("Localized")), QStringLiteral("\u00d6sterreichisch"));
+        QCOMPARE(names.value(QStringLiteral("Language")), QStringLiteral("Deutsch"));
+        QCOMPARE(names.value(QStringLiteral("Escaped")), QStringLiteral(" Leading\tTab"));
+        QCOMPARE(names.value(QStringLiteral("Unnamed")), QStringLiteral("Unnamed"));
+
+        // Just like KConfig reads them
+        for (const auto &id : {"Plain", "Localized", "Language", "Escaped"}) {
+            KConfig config(dataDir.filePath(QStringLiteral("color-schemes/%1.colors").arg(QLatin1String(id))), KConfig::SimpleConfig);
+            config.setLocale(QStringLiteral("de_AT"));
+            QCOMPARE(names.value(QLatin1String(id)), KConfigGroup(&config, QStringLiteral("General")).readEntry("Name"));
+        }
+    }
+
+    void schemeIndex()
+    {
+#ifndef Q_OS_UNIX
+        QSKIP("needs to set the modification time of a directory");
+#else
+        QTemporaryDir dataDir;
+        const QString schemesDir = dataDir.filePath(QStringLiteral("color-schemes"));
+        QVERIFY(QDir().mkpath(schemesDir));
+        // Files modified just now are always read again
+        const auto writeScheme = [&schemesDir](const QString &id, const QByteArray &name, const QDateTime &modified = QDateTime()) {
+            QFile file(schemesDir + QLatin1Char('/') + id + QStringLiteral(".colors"));
+            QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+            file.write("[General]\nName=" + name + "\n");
+            if (modified.isValid()) {
+                QVERIFY(file.setFileTime(modified, QFileDevice::FileModificationTime));
+            }
+        };
+        // Directories modified just now are always listed again
+        const auto setDirectoryModified = [&schemesDir](const QDateTime &modified) {
+            const auto seconds = static_cast<time_t>(modified.toSecsSinceEpoch());
+            const timeval times[2] = {{seconds, 0}, {seconds, 0}};
+            QCOMPARE(utimes(QFile::encodeName(schemesDir).constData(), times), 0);
+        };
+        const auto schemeNames = [&dataDir] {
+            const DataDirsOverride dataDirs(dataDir.path());
+            KColorSchemeModel model;
+            QHash<QString, QString> names;
+            for (int row = 1; row < model.rowCount(); ++row) {
+                const QModelIndex index = model.index(row);
+                names.insert(index.data(KColorSchemeModel::IdRole).toString(), index.data(KColorSchemeModel::NameRole).toString());
+            }
+            return names;
+        };
+
+        writeScheme(QStringLiteral("Indexed"), "Indexed", QDateTime::currentDateTime().addSecs(-3600));
+        writeScheme(QStringLiteral("Other"), "Other", QDateTime::currentDateTime().addSecs(-3600));
+        setDirectoryModified(QDateTime::currentDateTime().addSecs(-3600));
+        QCOMPARE(schemeNames().value(QStringLiteral("Indexed")), QStringLiteral("Indexed"));
+
+        // Editing a file in place doesn't modify the directory, the file is read again all the same
+        writeScheme(QStringLiteral("Indexed"), "Edited", QDateTime::currentDateTime().addSecs(-1800));
+        QCOMPARE(schemeNames().value(QStringLiteral("Indexed")), QStringLiteral("Edited"));
+
+        // Adding a file modifies it, the directory is listed again
+        writeScheme(QStringLiteral("Added"), "Added");
+        const auto names = schemeNames();
+        QCOMPARE(names.value(QStringLiteral("Indexed")), QStringLiteral("Edited"));
+        QCOMPARE(names.value(QStringLiteral("Other")), QStringLiteral("Other"));
+        QCOMPARE(names.value(QStringLiteral("Added")), QStringLiteral("Added"));
+#endif
+    }
+
+    void previews()
+    {
+        QTemporaryDir dataDir;
+        QVERIFY(QDir(dataDir.path()).mkpath(QStringLiteral("color-schemes")));
+        QFile file(dataDir.filePath(QStringLiteral("color-schemes/Preview.colors")));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("[Colors:Window]\nBackgroundNormal=10,20,30\n[Colors:Selection]\nBackgroundNormal=40,50,60\n");
+        file.close();
+
+        const DataDirsOverride dataDirs(dataDir.path());
+        KColorSchemeModel model;
+        const QModelIndex index = model.index(rowOf(model, QStringLiteral("Preview")));
+        QVERIFY(index.isValid());
+        QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+
+        // Asking for the preview doesn't render it right away
+        const QIcon placeholder = index.data(KColorSchemeModel::IconRole).value<QIcon>();
+        QVERIFY(!placeholder.isNull());
+        QCOMPARE(placeholder.pixmap(16).toImage().pixelColor(8, 8).alpha(), 0);
+
+        QTRY_COMPARE(changed.count(), 1);
+        QCOMPARE(changed.first().at(0).toModelIndex(), index);
+        QCOMPARE(changed.first().at(2).value<QList<int>>(), QList<int>{KColorSchemeModel::IconRole});
+        const QImage preview = index.data(KColorSchemeModel::IconRole).value<QIcon>().pixmap(24).toImage();
+        QCOMPARE(preview.pixelColor(4, 4), QColor(10, 20, 30));
+        QCOMPARE(preview.pixelColor(16, 16), QColor(40, 50, 60));
+
+        // Painted at any size and scale, not scaled up from a small pixmap
+        const QPixmap large = index.data(KColorSchemeModel::IconRole).value<QIcon>().pixmap(QSize(64, 64), 2.0);
+        QCOMPARE(large.size(), QSize(128, 128));
+        QCOMPARE(large.devicePixelRatio(), 2.0);
+        const QImage largeImage = large.toImage();
+        QCOMPARE(largeImage.pixelColor(0, 0), QColor(Qt::black));
+        QCOMPARE(largeImage.pixelColor(1, 1), QColor(10, 20, 30));
+        QCOMPARE(largeImage.pixelColor(126, 126), QColor(40, 50, 60));
+
+        // Once rendered, it's kept
+        QCOMPARE(index.data(KColorSchemeModel::IconRole).value<QIcon>().cacheKey(), renderedPreview(index).cacheKey());
+        QTest::qWait(50);
+        QCOMPARE(changed.count(), 1);
+    }
+
+    void storedPreviews()
+    {
+        QTemporaryDir dataDir;
+        QVERIFY(QDir(dataDir.path()).mkpath(QStringLiteral("color-schemes")));
+        const QString path = dataDir.filePath(QStringLiteral("color-schemes/Stored.colors"));
+        const auto writeScheme = [&path](const QByteArray &window) {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+            file.write("[Colors:Window]\nBackgroundNormal=" + window + "\n");
+        };
+        const auto windowColor = [](const QIcon &preview) {
+            return preview.pixmap(16).toImage().pixelColor(4, 4);
+        };
+        writeScheme("10,20,30");
+        const QDateTime modified = QDateTime::currentDateTime().addSecs(-3600);
+        {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QVERIFY(file.setFileTime(modified, QFileDevice::FileModificationTime));
+        }
+
+        const DataDirsOverride dataDirs(dataDir.path());
+        {
+            KColorSchemeModel model;
+            QCOMPARE(windowColor(renderedPreview(model.index(rowOf(model, QStringLiteral("Stored"))))), QColor(10, 20, 30));
+        }
+
+        // Changing the contents behind the back of the cache shows that the file isn't read again
+        writeScheme("40,50,60");
+        {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QVERIFY(file.setFileTime(modified, QFileDevice::FileModificationTime));
+        }
+        {
+            KColorSchemeModel model;
+            const QIcon preview = model.index(rowOf(model, QStringLiteral("Stored"))).data(KColorSchemeModel::IconRole).value<QIcon>();
+            QCOMPARE(windowColor(preview), QColor(10, 20, 30));
+        }
+
+        // Once the file is modified, its preview is rendered again
+        {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QVERIFY(file.setFileTime(modified.addSecs(60), QFileDevice::FileModificationTime));
+        }
+        {
+            KColorSchemeModel model;
+            const QModelIndex index = model.index(rowOf(model, QStringLiteral("Stored")));
+            QCOMPARE(index.data(KColorSchemeModel::IconRole).value<QIcon>().pixmap(16).toImage().pixelColor(0, 0).alpha(), 0);
+            QCOMPARE(windowColor(renderedPreview(index)), QColor(40, 50, 60));
+        }
+    }
+
+    void watchSchemes()
+    {
+        QTemporaryDir dataDir;
+        const QString schemesDir = dataDir.filePath(QStringLiteral("color-schemes"));
+        QVERIFY(QDir().mkpath(schemesDir));
+        const auto writeScheme = [&schemesDir](const QString &id, const QByteArray &name) {
+            // Replacing the file, like installers do, modifies the directory
+            QSaveFile file(schemesDir + QLatin1Char('/') + id + QStringLiteral(".colors"));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write("[General]\nName=" + name + "\n");
+            QVERIFY(file.commit());
+        };
+        writeScheme(QStringLiteral("Kept"), "Kept");
+        writeScheme(QStringLiteral("Removed"), "Removed");
+        writeScheme(QStringLiteral("Replaced"), "Replaced");
+
+        const DataDirsOverride dataDirs(dataDir.path());
+        KColorSchemeModel model;
+        const auto row = [&model](const QString &id) {
+            return rowOf(model, id);
+        };
+        // Along with the default entry and the bundled schemes
+        const int rowCount = model.rowCount();
+        QVERIFY(row(QStringLiteral("Removed")) > 0);
+        const qint64 keptPreview = renderedPreview(model.index(row(QStringLiteral("Kept")))).cacheKey();
+
+        QSignalSpy reset(&model, &QAbstractItemModel::modelReset);
+        QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+        QSignalSpy removed(&model, &QAbstractItemModel::rowsRemoved);
+        QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+
+        writeScheme(QStringLiteral("Added"), "Added");
+        QVERIFY(QFile::remove(schemesDir + QStringLiteral("/Removed.colors")));
+        QTRY_COMPARE(inserted.count(), 1);
+        QTRY_COMPARE(removed.count(), 1);
+        QCOMPARE(model.rowCount(), rowCount);
+        QCOMPARE(model.index(row(QStringLiteral("Added"))).data(KColorSchemeModel::NameRole).toString(), QStringLiteral("Added"));
+        QCOMPARE(row(QStringLiteral("Removed")), -1);
+
+        writeScheme(QStringLiteral("Replaced"), "Renamed");
+        QTRY_COMPARE(changed.count(), 1);
+        QCOMPARE(changed.first().at(0).toModelIndex().row(), row(QStringLiteral("Replaced")));
+        QCOMPARE(model.index(row(QStringLiteral("Replaced"))).data(KColorSchemeModel::NameRole).toString(), QStringLiteral("Renamed"));
+
+        QCOMPARE(reset.count(), 0);
+        QCOMPARE(model.index(row(QStringLiteral("Kept"))).data(KColorSchemeModel::IconRole).value<QIcon>().cacheKey(), keptPreview);
+    }
+
+    void bundledSchemes_data()
+    {
+        QTest::addColumn<QString>("scheme");
+
+        QTest::newRow("BreezeDark") << QStringLiteral(":/org.kde.kcolorscheme/color-schemes/BreezeDark.colors");
+        QTest::newRow("BreezeLight") << QStringLiteral(":/org.kde.kcolorscheme/color-schemes/BreezeLight.colors");
+    }
+
+    void bundledSchemes()
+    {
+        // The bundled schemes are compiled in, they must resolve just like their files do
+        QFETCH(QString, scheme);
+        QTemporaryDir dir;
+        const QString file = dir.filePath(QStringLiteral("copy.colors"));
+        QVERIFY(QFile::copy(scheme, file));
+
+        const auto compiled = KSharedConfig::openConfig(scheme, KConfig::SimpleConfig);
+        const auto parsed = KSharedConfig::openConfig(file, KConfig::SimpleConfig);
+        QCOMPARE(KColorScheme::createApplicationPalette(compiled), KColorScheme::createApplicationPalette(parsed));
+        for (const auto state : {QPalette::Active, QPalette::Inactive, QPalette::Disabled}) {
+            for (int set = 0; set < KColorScheme::NColorSets; ++set) {
+                const auto colorSet = KColorScheme::ColorSet(set);
+                QCOMPARE(KColorScheme(state, colorSet, compiled), KColorScheme(state, colorSet, parsed));
+            }
+        }
+
+        // A config reading more than the file doesn't resolve from the compiled table
+        const QString overlay = dir.filePath(QStringLiteral("overlay.colors"));
+        {
+            KConfig config(overlay, KConfig::SimpleConfig);
+            KConfigGroup view(&config, QStringLiteral("Colors:View"));
+            KConfigGroup(&view, QStringLiteral("Inactive")).writeEntry("BackgroundNormal", QColor(7, 8, 9));
+        }
+        const auto layeredCompiled = KSharedConfig::openConfig(scheme, KConfig::CascadeConfig);
+        layeredCompiled->addConfigSources({overlay});
+        const auto layeredParsed = KSharedConfig::openConfig(file, KConfig::CascadeConfig);
+        layeredParsed->addConfigSources({overlay});
+        const KColorScheme layered(QPalette::Inactive, KColorScheme::View, layeredCompiled);
+        QCOMPARE(layered, KColorScheme(QPalette::Inactive, KColorScheme::View, layeredParsed));
+        QVERIFY(!(layered == KColorScheme(QPalette::Inactive, KColorScheme::View, compiled)));
+    }
+
+    void configState()
+    {
+        // Schemes resolve from what their config holds, even when its file changed since
+        QTemporaryDir dir;
+        const QString file = dir.filePath(QStringLiteral("state.colors"));
+        QVERIFY(QFile::copy(QFINDTESTDATA("kcolorschemetest.colors"), file));
+        QVERIFY(QFile::setPermissions(file, QFile::ReadOwner | QFile::WriteOwner));
+
+        const auto stale = KSharedConfig::openConfig(file, KConfig::SimpleConfig);
+        const QColor background = KConfigGroup(stale, QStringLiteral("Colors:View")).readEntry("BackgroundNormal", QColor());
+        {
+            KConfig config(file, KConfig::SimpleConfig);
+            KConfigGroup(&config, QStringLiteral("Colors:View")).writeEntry("BackgroundNormal", QColor(4, 5, 6));
+        }
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::View, stale).background().color(), background);
+
+        // Extra sources of a config are part of its scheme
+        const QString overlay = dir.filePath(QStringLiteral("overlay.colors"));
+        {
+            KConfig config(overlay, KConfig::SimpleConfig);
+            KConfigGroup(&config, QStringLiteral("Colors:View")).writeEntry("BackgroundNormal", QColor(7, 8, 9));
+        }
+        const auto layered = KSharedConfig::openConfig(dir.filePath(QStringLiteral("layered.colors")), KConfig::SimpleConfig);
+        layered->addConfigSources({overlay});
+        QCOMPARE(KColorScheme(QPalette::Active, KColorScheme::View, layered).background().color(), QColor(7, 8, 9));
     }
 };
 
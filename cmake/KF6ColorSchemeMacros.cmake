@@ -0,0 +1,110 @@
+# SPDX-FileCopyrightText: 2026 KDE Contributors
+# SPDX-License-Identifier: BSD-2-Clause
+
+#[=======================================================================[.rst:
+kcolorscheme_compile_schemes
+----------------------------
+
+Compiles color schemes into tables that are added to the resources of
+``<target>``, so that KColorScheme resolves them without reading their files::
+
+  kcolorscheme_compile_schemes(<target>
+      PREFIX <resource prefix> [BASE <directory>] | DESTINATION <install directory>
+      FILES <file.colors> [...]
+      [OUTPUT_TARGETS <variable>]
+  )
+
+``PREFIX`` compiles every file for the path ``qt_add_resources()`` with the
+same prefix and base gives it, e.g. ``:/<resource prefix>/color-schemes/Foo.colors``
+for ``color-schemes/Foo.colors``. Files have to be below ``BASE``, which
+defaults to the current source directory.
+``DESTINATION`` compiles every file for the path it is installed to instead,
+relative paths being relative to ``CMAKE_INSTALL_PREFIX``. The installed file
+must not be changed afterwards.
+
+A table is only looked up when a scheme is resolved from a config that reads
+nothing but the file at its path: a config opened with ``KConfig::IncludeGlobals``,
+with additional config sources or with unsaved changes is read as usual.
+
+``OUTPUT_TARGETS`` works as it does for ``qt_add_resources()``, the object
+libraries it names need to be installed along with a static ``<target>``.
+
+When cross-compiling, the compiler of a host build is used if ``KF6_HOST_TOOLING``
+points to it.
+
+Since 6.29
+#]=======================================================================]
+function(kcolorscheme_compile_schemes target)
+    set(options)
+    set(oneValueArgs PREFIX BASE DESTINATION OUTPUT_TARGETS)
+    set(multiValueArgs FILES)
+    cmake_parse_arguments(ARGS "${options}" "${oneValueArgs}" "${multiValueArgs}" ${ARGN})
+
+    if(ARGS_UNPARSED_ARGUMENTS)
+        message(FATAL_ERROR "Unknown arguments to kcolorscheme_compile_schemes: ${ARGS_UNPARSED_ARGUMENTS}")
+    endif()
+    if(NOT ARGS_FILES)
+        message(FATAL_ERROR "kcolorscheme_compile_schemes needs at least one file in FILES")
+    endif()
+    if((ARGS_PREFIX AND ARGS_DESTINATION) OR (NOT ARGS_PREFIX AND NOT ARGS_DESTINATION))
+        message(FATAL_ERROR "kcolorscheme_compile_schemes needs either PREFIX or DESTINATION")
+    endif()
+    if(ARGS_BASE AND NOT ARGS_PREFIX)
+        message(FATAL_ERROR "kcolorscheme_compile_schemes only takes BASE along with PREFIX")
+    endif()
+
+    if(ARGS_BASE)
+        get_filename_component(base "${ARGS_BASE}" ABSOLUTE)
+    else()
+        set(base "${CMAKE_CURRENT_SOURCE_DIR}")
+    endif()
+
+    # Tables are named after the path the application opens their scheme from
+    set(tables_dir "${CMAKE_CURRENT_BINARY_DIR}/kcolorscheme-tables")
+    set(tables)
+    set(paths)
+    foreach(file IN LISTS ARGS_FILES)
+        get_filename_component(input "${file}" ABSOLUTE)
+        get_filename_component(name "${file}" NAME)
+
+        if(ARGS_PREFIX)
+            cmake_path(IS_PREFIX base "${input}" NORMALIZE is_below_base)
+            if(NOT is_below_base)
+                message(FATAL_ERROR "kcolorscheme_compile_schemes: ${file} is not below ${base}, pass the BASE it gets in qt_add_resources()")
+            endif()
+            cmake_path(RELATIVE_PATH input BASE_DIRECTORY "${base}" OUTPUT_VARIABLE alias)
+            string(REGEX REPLACE "/+$" "" prefix "${ARGS_PREFIX}")
+            set(path ":${prefix}/${alias}")
+        elseif(IS_ABSOLUTE "${ARGS_DESTINATION}")
+            set(path "${ARGS_DESTINATION}/${name}")
+        else()
+            set(path "${CMAKE_INSTALL_PREFIX}/${ARGS_DESTINATION}/${name}")
+        endif()
+
+        string(SHA1 table_name "${path}")
+        set(output "${tables_dir}/${table_name}")
+        add_custom_command(
+            OUTPUT "${output}"
+            COMMAND KF6::kcolorscheme_compiler "${input}" "${output}"
+            DEPENDS "${input}"
+            COMMENT "Compiling color scheme ${name}"
+            VERBATIM
+        )
+        list(APPEND tables "${output}")
+        string(APPEND paths "${path}\n")
+    endforeach()
+
+    # The tables are read in place, they must not be compressed
+    string(SHA1 resource_id "${target}\n${paths}")
+    string(SUBSTRING "${resource_id}" 0 12 resource_id)
+    qt_add_resources(${target} "kcolorscheme_tables_${resource_id}"
+        PREFIX "/kcolorscheme-tables"
+        BASE "${tables_dir}"
+        FILES ${tables}
+        OPTIONS -no-compress
+        OUTPUT_TARGETS output_targets
+    )
+    if(ARGS_OUTPUT_TARGETS)
+        set(${ARGS_OUTPUT_TARGETS} ${output_targets} PARENT_SCOPE)
+    endif()
+endfunction()
@@ -6,7 +6,11 @@
 */
 
 #include "kcolorscheme.h"
+#include "kcolorschemecompiled_p.h"
 #include "kcolorschemehelpers_p.h"
+#include "kcolorschemesnapshot.h"
+#include "kcolorschememanager_p.h"
+#include "kcolorschemetable_p.h"
 
 #include "kcolorscheme_debug.h"
 
@@ -16,84 +20,371 @@
 
 #include <QBrush>
 #include <QColor>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDynamicPropertyChangeEvent>
+#include <QFile>
+#include <QFileInfo>
 #include <QGuiApplication>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimeZone>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// BEGIN scheme generation
+static std::atomic<quint64> s_colorSchemeGeneration = 1;
+
+// Set while activateDefaultColorScheme() announces a scheme it resolves itself
+static bool s_announcingScheme = false;
+
+quint64 colorSchemeGeneration()
+{
+    return s_colorSchemeGeneration.load(std::memory_order_acquire);
+}
 
-// BEGIN StateEffects
-StateEffects::StateEffects(QPalette::ColorGroup state, const KSharedConfigPtr &config)
-    : _color(0, 0, 0, 0) //, _chain(0) not needed yet
+static std::atomic<quint64> s_effectsCacheHits = 0;
+static std::atomic<quint64> s_effectsCacheMisses = 0;
+
+void invalidateColorSchemeCaches()
 {
-    QString group;
-    if (state == QPalette::Disabled) {
-        group = QStringLiteral("ColorEffects:Disabled");
-    } else if (state == QPalette::Inactive) {
-        group = QStringLiteral("ColorEffects:Inactive");
+    s_colorSchemeGeneration.fetch_add(1, std::memory_order_acq_rel);
+    qCDebug(KCOLORSCHEME) << "Color scheme changed, state effects cache had" << s_effectsCacheHits.exchange(0, std::memory_order_relaxed) << "hits and"
+                          << s_effectsCacheMisses.exchange(0, std::memory_order_relaxed) << "misses";
+}
+
+namespace
+{
+// Watches the application object for changes that may affect the colors of the default scheme
+class SchemeChangeWatcher : public QObject
+{
+public:
+    using QObject::QObject;
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override
+    {
+        if (watched != qApp || s_announcingScheme) {
+            return false;
+        }
+        // A palette change can also come from a change of the contrast preference
+        if (event->type() == QEvent::ApplicationPaletteChange) {
+            updateDefaultColorScheme();
+        } else if (event->type() == QEvent::DynamicPropertyChange
+                   && static_cast<QDynamicPropertyChangeEvent *>(event)->propertyName() == "KDE_COLOR_SCHEME_PATH") {
+            updateDefaultColorScheme();
+        }
+        return false;
+    }
+};
+}
+// END scheme generation
+
+// BEGIN default scheme
+// The scheme the application uses, as published to all threads
+struct DefaultColorScheme {
+    QString path;
+    bool useSystemPalette = false;
+    // The application palette is not safe to read outside of the GUI thread, so keep a copy
+    QPalette systemPalette;
+    // Stamps of the scheme's files when it was resolved, see CompiledScheme::sourceStamps()
+    QByteArray stamps;
+    // The application palette made from the scheme, if it was
+    std::optional<QPalette> palette;
+};
+
+Q_CONSTINIT static QBasicMutex s_defaultSchemeMutex;
+static std::shared_ptr<const DefaultColorScheme> s_defaultScheme;
+// Whether the scheme was used before the application object existed
+static bool s_usedWithoutApplication = false;
+
+static std::shared_ptr<DefaultColorScheme> readDefaultColorScheme(const QString &path)
+{
+    auto scheme = std::make_shared<DefaultColorScheme>();
+    // Read from the application's color scheme file (as set by KColorSchemeManager).
+    // If unset, this is equivalent to openConfig() and the system scheme is used.
+    scheme->path = path;
+    // If no color scheme is set and high-contrast is active then use the system colors
+    scheme->useSystemPalette =
+        scheme->path.isEmpty() && qGuiApp && KColorSchemeManagerPrivate::contrastPreference() == KColorSchemeManagerPrivate::HighContrast;
+    if (scheme->useSystemPalette) {
+        scheme->systemPalette = QGuiApplication::palette();
     }
+    return scheme;
+}
 
-    for (auto &effect : _effects) {
-        effect = 0;
+/*
+ * Follows changes of the application's scheme from its first use on, so that
+ * applications that never use it don't filter their events for it. Only a GUI
+ * application has palettes to follow.
+ */
+static void watchSchemeChanges()
+{
+    if (!qGuiApp) {
+        return;
+    }
+    if (QThread::isMainThread()) {
+        qApp->installEventFilter(new SchemeChangeWatcher(qApp));
+        return;
     }
+    // The filter has to live in the thread of the application object
+    QMetaObject::invokeMethod(
+        qApp,
+        [] {
+            qApp->installEventFilter(new SchemeChangeWatcher(qApp));
+            // Catch up with a scheme set while the filter was on its way
+            QString path;
+            {
+                QMutexLocker locker(&s_defaultSchemeMutex);
+                path = s_defaultScheme->path;
+            }
+            if (qApp->property("KDE_COLOR_SCHEME_PATH").toString() != path) {
+                updateDefaultColorScheme();
+            }
+        },
+        Qt::QueuedConnection);
+}
 
+static std::shared_ptr<const DefaultColorScheme> currentDefaultColorScheme()
+{
+    {
+        QMutexLocker locker(&s_defaultSchemeMutex);
+        if (s_defaultScheme) {
+            return s_defaultScheme;
+        }
+        if (!qApp) {
+            // There is nothing to follow yet, the system scheme is all there is
+            static const auto withoutApplication = std::make_shared<const DefaultColorScheme>();
+            s_usedWithoutApplication = true;
+            return withoutApplication;
+        }
+        s_defaultScheme = readDefaultColorScheme(qApp->property("KDE_COLOR_SCHEME_PATH").toString());
+        if (s_usedWithoutApplication) {
+            // Drop what was resolved before the application could set its scheme
+            invalidateColorSchemeCaches();
+        }
+    }
+    // Not with the lock held, adding the filter sends an event to the application's filters
+    watchSchemeChanges();
+    return currentDefaultColorScheme();
+}
+
+// The palette to take colors from when the application's scheme is the system palette
+static QPalette defaultSystemPalette()
+{
+    return currentDefaultColorScheme()->systemPalette;
+}
+
+KSharedConfigPtr defaultConfig()
+{
+    // cache the value we'll return, since usually it's going to be the same value
+    static thread_local quint64 generation = 0;
+    static thread_local QString path;
+    static thread_local KSharedConfigPtr config;
+
+    const quint64 currentGeneration = colorSchemeGeneration();
+    if (generation == currentGeneration) {
+        return config;
+    }
+
+    const auto scheme = currentDefaultColorScheme();
+    generation = currentGeneration;
+
+    if (scheme->useSystemPalette) {
+        config.reset();
+    } else if (!config || path != scheme->path) {
+        config = KSharedConfig::openConfig(scheme->path);
+    }
+    path = scheme->path;
+    return config;
+}
+// END default scheme
+
+// BEGIN StateEffects
+template<typename Reader>
+void StateEffects::readEffects(QPalette::ColorGroup state, const Reader &read)
+{
     // NOTE: keep this in sync with kdebase/workspace/kcontrol/colors/colorscm.cpp
+    if (state == QPalette::Inactive) {
+        _changeSelectionColor = read("ChangeSelectionColor", read("Enable", true));
+    }
+    const bool enabledByDefault = (state == QPalette::Disabled);
+    if (read("Enable", enabledByDefault)) {
+        _effects[Intensity] = read("IntensityEffect", (int)(state == QPalette::Disabled ? IntensityDarken : IntensityNoEffect));
+        _effects[Color] = read("ColorEffect", (int)(state == QPalette::Disabled ? ColorNoEffect : ColorDesaturate));
+        _effects[Contrast] = read("ContrastEffect", (int)(state == QPalette::Disabled ? ContrastFade : ContrastTint));
+        _amount[Intensity] = read("IntensityAmount", state == QPalette::Disabled ? 0.10 : 0.0);
+        _amount[Color] = read("ColorAmount", state == QPalette::Disabled ? 0.0 : -0.9);
+        _amount[Contrast] = read("ContrastAmount", state == QPalette::Disabled ? 0.65 : 0.25);
+        if (_effects[Color] > ColorNoEffect) {
+            _color = read("Color", state == QPalette::Disabled ? QColor(56, 56, 56) : QColor(112, 111, 110));
+        }
+    }
+}
+
+// Reads the entries of a ColorEffects:* group for readEffects()
+static auto configReader(const KConfigGroup &group)
+{
+    return [&group](const char *key, const auto &defaultValue) {
+        return group.readEntry(key, defaultValue);
+    };
+}
+
+StateEffects::StateEffects(QPalette::ColorGroup state, const KSharedConfigPtr &config)
+    : _color(0, 0, 0, 0) //, _chain(0) not needed yet
+{
+    const QString group = groupName(state);
     if (!group.isEmpty()) {
-        KConfigGroup cfg(config, group);
-        const bool enabledByDefault = (state == QPalette::Disabled);
-        if (cfg.readEntry("Enable", enabledByDefault)) {
-            _effects[Intensity] = cfg.readEntry("IntensityEffect", (int)(state == QPalette::Disabled ? IntensityDarken : IntensityNoEffect));
-            _effects[Color] = cfg.readEntry("ColorEffect", (int)(state == QPalette::Disabled ? ColorNoEffect : ColorDesaturate));
-            _effects[Contrast] = cfg.readEntry("ContrastEffect", (int)(state == QPalette::Disabled ? ContrastFade : ContrastTint));
-            _amount[Intensity] = cfg.readEntry("IntensityAmount", state == QPalette::Disabled ? 0.10 : 0.0);
-            _amount[Color] = cfg.readEntry("ColorAmount", state == QPalette::Disabled ? 0.0 : -0.9);
-            _amount[Contrast] = cfg.readEntry("ContrastAmount", state == QPalette::Disabled ? 0.65 : 0.25);
-            if (_effects[Color] > ColorNoEffect) {
-                _color = cfg.readEntry("Color", state == QPalette::Disabled ? QColor(56, 56, 56) : QColor(112, 111, 110));
-            }
+        const KConfigGroup cfg(config, group);
+        readEffects(state, configReader(cfg));
+    }
+}
+
+StateEffects::StateEffects(QPalette::ColorGroup state, const KConfigGroup &group)
+    : _color(0, 0, 0, 0)
+{
+    readEffects(state, configReader(group));
+}
+
+StateEffects::StateEffects(QPalette::ColorGroup state, QSpan<const quint64> table)
+    : _color(0, 0, 0, 0)
+{
+    Q_ASSERT(table.size() == SchemeTable::effectGroupSize);
+    readEffects(state, [table](const char *key, const auto &defaultValue) -> std::decay_t<decltype(defaultValue)> {
+        using T = std::decay_t<decltype(defaultValue)>;
+        const std::size_t index = SchemeTable::effectKeyIndex(key);
+        if (index >= SchemeTable::effectKeys.size() || !(table[0] & (quint64(1) << index))) {
+            return defaultValue;
+        }
+        const quint64 value = table[1 + index];
+        if constexpr (std::is_same_v<T, bool>) {
+            return value != 0;
+        } else if constexpr (std::is_same_v<T, int>) {
+            return int(qint64(value));
+        } else if constexpr (std::is_same_v<T, double>) {
+            return std::bit_cast<double>(value);
+        } else {
+            return QColor(QRgba64::fromRgba64(value));
         }
+    });
+}
+
+QString StateEffects::groupName(QPalette::ColorGroup state)
+{
+    if (state == QPalette::Disabled) {
+        return QStringLiteral("ColorEffects:Disabled");
+    } else if (state == QPalette::Inactive) {
+        return QStringLiteral("ColorEffects:Inactive");
     }
+    return QString();
 }
 
 QBrush StateEffects::brush(const QBrush &background) const
 {
-    QColor color = background.color(); // TODO - actually work on brushes
+    return QBrush(color(background.color())); // TODO - actually work on brushes
+}
+
+QBrush StateEffects::brush(const QBrush &foreground, const QBrush &background) const
+{
+    return QBrush(color(foreground.color(), background.color())); // TODO - actually work on brushes
+}
+
+QColor StateEffects::color(const QColor &background) const
+{
+    QColor color = background;
+    apply(QSpan<QColor>(&color, 1));
+    return color;
+}
+
+QColor StateEffects::color(const QColor &foreground, const QColor &background) const
+{
+    QColor color = foreground;
+    apply(QSpan<QColor>(&color, 1), background);
+    return color;
+}
+
+// Replaces every color by transform(color)
+template<typename Transform>
+static void transformColors(QSpan<QColor> colors, Transform transform)
+{
+    for (QColor &color : colors) {
+        color = transform(color);
+    }
+}
+
+void StateEffects::apply(QSpan<QColor> colors) const
+{
+    // Pick each effect once for the whole batch, the result for a single color is the same
+    const double intensityAmount = _amount[Intensity];
     switch (_effects[Intensity]) {
     case IntensityShade:
-        color = KColorUtils::shade(color, _amount[Intensity]);
+        transformColors(colors, [intensityAmount](const QColor &color) {
+            return KColorUtils::shade(color, intensityAmount);
+        });
         break;
     case IntensityDarken:
-        color = KColorUtils::darken(color, _amount[Intensity]);
+        transformColors(colors, [intensityAmount](const QColor &color) {
+            return KColorUtils::darken(color, intensityAmount);
+        });
         break;
     case IntensityLighten:
-        color = KColorUtils::lighten(color, _amount[Intensity]);
+        transformColors(colors, [intensityAmount](const QColor &color) {
+            return KColorUtils::lighten(color, intensityAmount);
+        });
         break;
     }
+
+    const double colorAmount = _amount[Color];
+    const QColor effectColor = _color;
     switch (_effects[Color]) {
     case ColorDesaturate:
-        color = KColorUtils::darken(color, 0.0, 1.0 - _amount[Color]);
+        transformColors(colors, [colorAmount](const QColor &color) {
+            return KColorUtils::darken(color, 0.0, 1.0 - colorAmount);
+        });
         break;
     case ColorFade:
-        color = KColorUtils::mix(color, _color, _amount[Color]);
+        transformColors(colors, [colorAmount, effectColor](const QColor &color) {
+            return KColorUtils::mix(color, effectColor, colorAmount);
+        });
         break;
     case ColorTint:
-        color = KColorUtils::tint(color, _color, _amount[Color]);
+        transformColors(colors, [colorAmount, effectColor](const QColor &color) {
+            return KColorUtils::tint(color, effectColor, colorAmount);
+        });
         break;
     }
-    return QBrush(color);
 }
 
-QBrush StateEffects::brush(const QBrush &foreground, const QBrush &background) const
+void StateEffects::apply(QSpan<QColor> foregrounds, const QColor &background) const
 {
-    QColor color = foreground.color(); // TODO - actually work on brushes
-    QColor bg = background.color();
     // Apply the foreground effects
+    const double contrastAmount = _amount[Contrast];
     switch (_effects[Contrast]) {
     case ContrastFade:
-        color = KColorUtils::mix(color, bg, _amount[Contrast]);
+        transformColors(foregrounds, [contrastAmount, &background](const QColor &color) {
+            return KColorUtils::mix(color, background, contrastAmount);
+        });
         break;
     case ContrastTint:
-        color = KColorUtils::tint(color, bg, _amount[Contrast]);
+        transformColors(foregrounds, [contrastAmount, &background](const QColor &color) {
+            return KColorUtils::tint(color, background, contrastAmount);
+        });
         break;
     }
     // Now apply global effects
-    return brush(color);
+    apply(foregrounds);
 }
 // END StateEffects
 
@@ -119,7 +410,7 @@ struct DecorationColors {
 // clang-format off
 // These numbers come from the default color scheme which is currently
 // Breeze Light ([breeze repo]/colors/BreezeLight.colors)
-static const SerializedColors defaultViewColors = {
+static constexpr SerializedColors defaultViewColors = {
     { 255, 255, 255 }, // Background
     { 247, 247, 247 }, // Alternate
     {  35,  38, 41  }, // Normal
@@ -132,7 +423,7 @@ static const SerializedColors defaultViewColors = {
     {  39, 174,  96 }  // Positive
 };
 
-static const SerializedColors defaultWindowColors = {
+static constexpr SerializedColors defaultWindowColors = {
     { 239, 240, 241 }, // Background
     { 227, 229, 231 }, // Alternate
     {  35,  38, 41  }, // Normal
@@ -145,7 +436,7 @@ static const SerializedColors defaultWindowColors = {
     {  39, 174,  96 }  // Positive
 };
 
-static const SerializedColors defaultButtonColors = {
+static constexpr SerializedColors defaultButtonColors = {
     { 252, 252, 252 }, // Background
     { 163, 212, 250 }, // Alternate
     {  35,  38, 41  }, // Normal
@@ -158,7 +449,7 @@ static const SerializedColors defaultButtonColors = {
     {  39, 174,  96 }  // Positive
 };
 
-static const SerializedColors defaultSelectionColors = {
+static constexpr SerializedColors defaultSelectionColors = {
     {  61, 174, 233 }, // Background
     { 163, 212, 250 }, // Alternate
     { 255, 255, 255 }, // Normal
@@ -171,7 +462,7 @@ static const SerializedColors defaultSelectionColors = {
     {  23, 104,  57 }  // Positive
 };
 
-static const SerializedColors defaultTooltipColors = {
+static constexpr SerializedColors defaultTooltipColors = {
     { 247, 247, 247 }, // Background
     { 239, 240, 241 }, // Alternate
     {  35,  38,  41 }, // Normal
@@ -184,7 +475,7 @@ static const SerializedColors defaultTooltipColors = {
     {  39, 174,  96 }  // Positive
 };
 
-static const SerializedColors defaultComplementaryColors = {
+static constexpr SerializedColors defaultComplementaryColors = {
     {  42,  46,  50 }, // Background
     {  27,  30,  32 }, // Alternate
     { 252, 252, 252 }, // Normal
@@ -197,7 +488,7 @@ static const SerializedColors defaultComplementaryColors = {
     {  39, 174,  96 }  // Positive
 };
 
-static const SerializedColors defaultHeaderColors = {
+static constexpr SerializedColors defaultHeaderColors = {
     { 222, 224, 226 }, // Background
     { 239, 240, 241 }, // Alternate
     {  35,  38,  41 }, // Normal
@@ -210,207 +501,356 @@ static const SerializedColors defaultHeaderColors = {
     {  39, 174,  96 }  // Positive
 };
 
-static const DecorationColors defaultDecorationColors = {
+static constexpr DecorationColors defaultDecorationColors = {
     {  61, 174, 233 }, // Focus
     { 147, 206, 233 }, // Hover
 };
 // END default colors
 // clang-format on
 
+// BEGIN SchemeData
+// clang-format off
+constexpr std::array serializedColorKeys = {
+    std::pair{"ForegroundNormal", &SerializedColors::NormalText},
+    std::pair{"ForegroundInactive", &SerializedColors::InactiveText},
+    std::pair{"ForegroundActive", &SerializedColors::ActiveText},
+    std::pair{"ForegroundLink", &SerializedColors::LinkText},
+    std::pair{"ForegroundVisited", &SerializedColors::VisitedText},
+    std::pair{"ForegroundNegative", &SerializedColors::NegativeText},
+    std::pair{"ForegroundNeutral", &SerializedColors::NeutralText},
+    std::pair{"ForegroundPositive", &SerializedColors::PositiveText},
+    std::pair{"BackgroundNormal", &SerializedColors::NormalBackground},
+    std::pair{"BackgroundAlternate", &SerializedColors::AlternateBackground},
+};
+
+constexpr std::array decorationColorKeys = {
+    std::pair{"DecorationFocus", &DecorationColors::Focus},
+    std::pair{"DecorationHover", &DecorationColors::Hover},
+};
+// clang-format on
+
+static QString colorSetGroupName(KColorScheme::ColorSet set)
+{
+    switch (set) {
+    case KColorScheme::View:
+        return QStringLiteral("Colors:View");
+    case KColorScheme::Window:
+        return QStringLiteral("Colors:Window");
+    case KColorScheme::Button:
+        return QStringLiteral("Colors:Button");
+    case KColorScheme::Selection:
+        return QStringLiteral("Colors:Selection");
+    case KColorScheme::Tooltip:
+        return QStringLiteral("Colors:Tooltip");
+    case KColorScheme::Complementary:
+        return QStringLiteral("Colors:Complementary");
+    case KColorScheme::Header:
+        return QStringLiteral("Colors:Header");
+    case KColorScheme::NColorSets:
+        break;
+    }
+    return QString();
+}
+
+// Entries left unset get the default of the set they are used for, as readEntry() would give
+static ColorGroupEntries readColorGroup(const KConfigGroup &group)
+{
+    ColorGroupEntries entries;
+    for (std::size_t i = 0; i < serializedColorKeys.size(); ++i) {
+        entries.colors[i] = SchemeTable::readColor(group, serializedColorKeys[i].first);
+    }
+    for (std::size_t i = 0; i < decorationColorKeys.size(); ++i) {
+        entries.decoration[i] = SchemeTable::readColor(group, decorationColorKeys[i].first);
+    }
+    return entries;
+}
+
+static void readColorGroups(SchemeData &data, const KConfig *config)
+{
+    for (int set = 0; set < KColorScheme::NColorSets; ++set) {
+        const KConfigGroup group(config, colorSetGroupName(static_cast<KColorScheme::ColorSet>(set)));
+        data.groups[set] = readColorGroup(group);
+        const KConfigGroup inactiveGroup(&group, QStringLiteral("Inactive"));
+        if (inactiveGroup.exists()) {
+            data.inactiveGroups[set] = readColorGroup(inactiveGroup);
+        }
+    }
+}
+
+// Reads the scheme from a config of its own, past the caches kept for shared configs
+static SchemeData parseSchemeData(const KConfig &config)
+{
+    SchemeData data;
+    readColorGroups(data, &config);
+
+    data.inactiveEffects =
+        std::make_shared<const StateEffects>(QPalette::Inactive, KConfigGroup(&config, StateEffects::groupName(QPalette::Inactive)));
+    data.disabledEffects =
+        std::make_shared<const StateEffects>(QPalette::Disabled, KConfigGroup(&config, StateEffects::groupName(QPalette::Disabled)));
+
+    // Keep in sync with KColorSchemeCache::readContrast()
+    data.contrast = 0.1 * KConfigGroup(&config, QStringLiteral("KDE")).readEntry("contrast", 7);
+    return data;
+}
+
+static SchemeData readSchemeData(const KSharedConfigPtr &config)
+{
+    if (auto compiled = CompiledScheme::builtIn(config)) {
+        return *compiled;
+    }
+
+    SchemeData data;
+    readColorGroups(data, config.data());
+
+    data.inactiveEffects = StateEffects::forConfig(QPalette::Inactive, config);
+    data.disabledEffects = StateEffects::forConfig(QPalette::Disabled, config);
+
+    data.contrast = KColorScheme::contrastF(config);
+    return data;
+}
+
+static SerializedColors serializedColors(const ColorGroupEntries &entries, const SerializedColors &defaults)
+{
+    SerializedColors colors = defaults;
+    for (std::size_t i = 0; i < serializedColorKeys.size(); ++i) {
+        if (entries.colors[i]) {
+            colors.*(serializedColorKeys[i].second) = *entries.colors[i];
+        }
+    }
+    return colors;
+}
+
+static DecorationColors decorationColors(const ColorGroupEntries &entries, const DecorationColors &defaults)
+{
+    DecorationColors colors = defaults;
+    for (std::size_t i = 0; i < decorationColorKeys.size(); ++i) {
+        if (entries.decoration[i]) {
+            colors.*(decorationColorKeys[i].second) = *entries.decoration[i];
+        }
+    }
+    return colors;
+}
+// END SchemeData
+
 // BEGIN KColorSchemePrivate
 class KColorSchemePrivate : public QSharedData
 {
 public:
-    explicit KColorSchemePrivate(const KSharedConfigPtr &, QPalette::ColorGroup state, KColorScheme::ColorSet set);
+    explicit KColorSchemePrivate(const SchemeData &data, QPalette::ColorGroup state, KColorScheme::ColorSet set);
+    explicit KColorSchemePrivate(const QPalette &systemPalette, QPalette::ColorGroup state, KColorScheme::ColorSet set);
+    struct Colors;
+    // Takes over colors that were resolved completely before
+    explicit KColorSchemePrivate(const Colors &colors, qreal contrast);
     ~KColorSchemePrivate()
     {
     }
 
-    void initFromConfig(const KSharedConfigPtr &config, QPalette::ColorGroup state, KColorScheme::ColorSet set);
-    void initFromSystemPalette(QPalette::ColorGroup state, KColorScheme::ColorSet set);
+    void initFromData(const SchemeData &data, QPalette::ColorGroup state, KColorScheme::ColorSet set);
+    void initFromSystemPalette(const QPalette &systemPalette, QPalette::ColorGroup state, KColorScheme::ColorSet set);
+    void initShades();
+    void initDerivedColors() const;
+    void initBrushes() const;
+    void initDerivedBrushes() const;
 
     QBrush background(KColorScheme::BackgroundRole) const;
     QBrush foreground(KColorScheme::ForegroundRole) const;
     QBrush decoration(KColorScheme::DecorationRole) const;
+    QColor shade(KColorScheme::ShadeRole) const;
     qreal contrast() const;
+    bool operator==(const KColorSchemePrivate &other) const;
+    // All colors, including the derived ones
+    const auto &colors() const
+    {
+        initDerivedColors();
+        return _colors;
+    }
+
+    // Packed colors, the brushes below are only made from them when asked for
+    struct Colors {
+        std::array<QRgba64, KColorScheme::NForegroundRoles> fg;
+        std::array<QRgba64, KColorScheme::NBackgroundRoles> bg;
+        std::array<QRgba64, KColorScheme::NDecorationRoles> deco;
+        // KColorScheme::shade() of the normal background, precomputed
+        std::array<QRgba64, KColorScheme::NShadeRoles> shade;
 
+        bool operator==(const Colors &c) const
+        {
+            return this == &c || std::memcmp(this, &c, sizeof(Colors)) == 0;
+        }
+    };
+    // The derived backgrounds and the decoration colors are only final once
+    // initDerivedColors() ran, as most users never ask for them
+    mutable Colors _colors;
+    mutable std::once_flag _derivedColorsInitialized;
+    // Brushes of the colors, taken from the shared pool once the first one is asked for, so that
+    // handing one out is only a reference count increment. The derived ones come along with their colors.
     struct Brushes {
         std::array<QBrush, KColorScheme::NForegroundRoles> fg;
         std::array<QBrush, KColorScheme::NBackgroundRoles> bg;
         std::array<QBrush, KColorScheme::NDecorationRoles> deco;
-
-        bool operator==(const Brushes &b) const
-        {
-            return this == &b || (fg == b.fg && bg == b.bg && deco == b.deco);
-        }
-    } _brushes;
+    };
+    mutable Brushes _brushes;
+    mutable std::once_flag _brushesInitialized;
+    mutable std::once_flag _derivedBrushesInitialized;
+    // Effects still to be applied to the decoration colors, and the background they need
+    std::shared_ptr<const StateEffects> _decorationEffects;
+    QRgba64 _decorationEffectsBackground = {};
 
     qreal _contrast;
 };
 
-static SerializedColors loadSerializedColors(const KConfigGroup &group, const SerializedColors &defaults)
-{
-    constexpr std::array configMap = {
-        std::pair{"ForegroundNormal", &SerializedColors::NormalText},
-        std::pair{"ForegroundInactive", &SerializedColors::InactiveText},
-        std::pair{"ForegroundActive", &SerializedColors::ActiveText},
-        std::pair{"ForegroundLink", &SerializedColors::LinkText},
-        std::pair{"ForegroundVisited", &SerializedColors::VisitedText},
-        std::pair{"ForegroundNegative", &SerializedColors::NegativeText},
-        std::pair{"ForegroundNeutral", &SerializedColors::NeutralText},
-        std::pair{"ForegroundPositive", &SerializedColors::PositiveText},
-        std::pair{"BackgroundNormal", &SerializedColors::NormalBackground},
-        std::pair{"BackgroundAlternate", &SerializedColors::AlternateBackground},
-    };
-    SerializedColors loadedColors;
-    for (const auto &entry : configMap) {
-        loadedColors.*(entry.second) = group.readEntry(entry.first, defaults.*(entry.second));
-    }
-    return loadedColors;
+KColorSchemePrivate::KColorSchemePrivate(const SchemeData &data, QPalette::ColorGroup state, KColorScheme::ColorSet set)
+{
+    initFromData(data, state, set);
 }
 
-static DecorationColors loadDecorationColors(const KConfigGroup &group, const DecorationColors &defaults)
+KColorSchemePrivate::KColorSchemePrivate(const QPalette &systemPalette, QPalette::ColorGroup state, KColorScheme::ColorSet set)
 {
-    DecorationColors colors;
-    colors.Focus = group.readEntry("DecorationFocus", defaults.Focus);
-    colors.Hover = group.readEntry("DecorationHover", defaults.Hover);
-    return colors;
+    initFromSystemPalette(systemPalette, state, set);
 }
 
-KColorSchemePrivate::KColorSchemePrivate(const KSharedConfigPtr &config, QPalette::ColorGroup state, KColorScheme::ColorSet set)
+KColorSchemePrivate::KColorSchemePrivate(const Colors &colors, qreal contrast)
+    : _colors(colors)
+    , _contrast(contrast)
 {
-    if (config) {
-        initFromConfig(config, state, set);
-    } else {
-        initFromSystemPalette(state, set);
-    }
+    std::call_once(_derivedColorsInitialized, [] {});
 }
 
-void KColorSchemePrivate::initFromConfig(const KSharedConfigPtr &config, QPalette::ColorGroup state, KColorScheme::ColorSet set)
+void KColorSchemePrivate::initFromData(const SchemeData &data, QPalette::ColorGroup state, KColorScheme::ColorSet set)
 {
-    QString groupName;
+    KColorScheme::ColorSet group = set;
     SerializedColors defaultColors;
     DecorationColors defaultDecoColors = defaultDecorationColors;
     QColor tint;
     switch (set) {
     case KColorScheme::Window:
-        groupName = QStringLiteral("Colors:Window");
         defaultColors = defaultWindowColors;
         break;
     case KColorScheme::Button:
-        groupName = QStringLiteral("Colors:Button");
         defaultColors = defaultButtonColors;
         break;
-    case KColorScheme::Selection: {
-        const KConfigGroup inactiveEffectGroup(config, QStringLiteral("ColorEffects:Inactive"));
-        // NOTE: keep this in sync with kdebase/workspace/kcontrol/colors/colorscm.cpp
-        const bool inactiveSelectionEffect = inactiveEffectGroup.readEntry("ChangeSelectionColor", inactiveEffectGroup.readEntry("Enable", true));
+    case KColorScheme::Selection:
         // if enabled, inactive/disabled uses Window colors instead, ala gtk
         // ...except tinted with the Selection:NormalBackground color so it looks more like selection
-        if (state == QPalette::Active || (state == QPalette::Inactive && !inactiveSelectionEffect)) {
-            groupName = QStringLiteral("Colors:Selection");
+        if (state == QPalette::Active || (state == QPalette::Inactive && !data.inactiveEffects->changesSelectionColor())) {
             defaultColors = defaultSelectionColors;
         } else if (state == QPalette::Inactive) {
-            groupName = QStringLiteral("Colors:Window");
+            group = KColorScheme::Window;
             defaultColors = defaultWindowColors;
-            tint = config->group(QStringLiteral("Colors:Selection")).readEntry("BackgroundNormal", defaultSelectionColors.NormalBackground);
+            tint = serializedColors(data.groups[KColorScheme::Selection], defaultSelectionColors).NormalBackground;
         } else { // disabled (...and still want this branch when inactive+disabled exists)
-            groupName = QStringLiteral("Colors:Window");
+            group = KColorScheme::Window;
             defaultColors = defaultWindowColors;
         }
-    } break;
+        break;
     case KColorScheme::Tooltip:
-        groupName = QStringLiteral("Colors:Tooltip");
         defaultColors = defaultTooltipColors;
         break;
     case KColorScheme::Complementary:
-        groupName = QStringLiteral("Colors:Complementary");
         defaultColors = defaultComplementaryColors;
         break;
     case KColorScheme::Header:
-        groupName = QStringLiteral("Colors:Header");
-        defaultColors = loadSerializedColors(config->group(QStringLiteral("Colors:Window")), defaultHeaderColors);
-        defaultDecoColors = loadDecorationColors(config->group(QStringLiteral("Colors:Window")), defaultDecorationColors);
+        defaultColors = serializedColors(data.groups[KColorScheme::Window], defaultHeaderColors);
+        defaultDecoColors = decorationColors(data.groups[KColorScheme::Window], defaultDecorationColors);
         break;
     case KColorScheme::NColorSets:
         qCWarning(KCOLORSCHEME) << "ColorSet::NColorSets is not a valid color set value to pass to KColorScheme::KColorScheme";
         [[fallthrough]];
     case KColorScheme::View:
-        groupName = QStringLiteral("Colors:View");
+        group = KColorScheme::View;
         defaultColors = defaultViewColors;
         break;
     }
 
-    KConfigGroup cfg(config, groupName);
-    bool hasInactivePalette = false;
-    if (state == QPalette::Inactive) {
-        KConfigGroup inactiveGroup = KConfigGroup(&cfg, QStringLiteral("Inactive"));
-        if (inactiveGroup.exists()) {
-            cfg = inactiveGroup;
-            hasInactivePalette = true;
-        }
+    const ColorGroupEntries *entries = &data.groups[group];
+    if (state == QPalette::Inactive && data.inactiveGroups[group]) {
+        entries = &*data.inactiveGroups[group];
     }
 
-    _contrast = KColorScheme::contrastF(config);
+    _contrast = data.contrast;
 
-    const SerializedColors loadedColors = loadSerializedColors(cfg, defaultColors);
-    const DecorationColors loadedDecoColors = loadDecorationColors(cfg, defaultDecoColors);
+    const SerializedColors loadedColors = serializedColors(*entries, defaultColors);
+    const DecorationColors loadedDecoColors = decorationColors(*entries, defaultDecoColors);
 
-    _brushes.fg[KColorScheme::NormalText] = loadedColors.NormalText;
-    _brushes.fg[KColorScheme::InactiveText] = loadedColors.InactiveText;
-    _brushes.fg[KColorScheme::ActiveText] = loadedColors.ActiveText;
-    _brushes.fg[KColorScheme::LinkText] = loadedColors.LinkText;
-    _brushes.fg[KColorScheme::VisitedText] = loadedColors.VisitedText;
-    _brushes.fg[KColorScheme::NegativeText] = loadedColors.NegativeText;
-    _brushes.fg[KColorScheme::NeutralText] = loadedColors.NeutralText;
-    _brushes.fg[KColorScheme::PositiveText] = loadedColors.PositiveText;
+    std::array<QColor, KColorScheme::NForegroundRoles> fg;
+    fg[KColorScheme::NormalText] = loadedColors.NormalText;
+    fg[KColorScheme::InactiveText] = loadedColors.InactiveText;
+    fg[KColorScheme::ActiveText] = loadedColors.ActiveText;
+    fg[KColorScheme::LinkText] = loadedColors.LinkText;
+    fg[KColorScheme::VisitedText] = loadedColors.VisitedText;
+    fg[KColorScheme::NegativeText] = loadedColors.NegativeText;
+    fg[KColorScheme::NeutralText] = loadedColors.NeutralText;
+    fg[KColorScheme::PositiveText] = loadedColors.PositiveText;
 
-    _brushes.bg[KColorScheme::NormalBackground] = loadedColors.NormalBackground;
-    _brushes.bg[KColorScheme::AlternateBackground] = loadedColors.AlternateBackground;
+    QColor normalBackground = loadedColors.NormalBackground;
+    QColor alternateBackground = loadedColors.AlternateBackground;
 
-    _brushes.deco[KColorScheme::FocusColor] = loadedDecoColors.Focus;
-    _brushes.deco[KColorScheme::HoverColor] = loadedDecoColors.Hover;
+    std::array<QColor, KColorScheme::NDecorationRoles> deco;
+    deco[KColorScheme::FocusColor] = loadedDecoColors.Focus;
+    deco[KColorScheme::HoverColor] = loadedDecoColors.Hover;
 
     if (tint.isValid()) {
         // adjustment
-        _brushes.bg[KColorScheme::NormalBackground] = KColorUtils::tint(_brushes.bg[KColorScheme::NormalBackground].color(), tint, 0.4);
-        _brushes.bg[KColorScheme::AlternateBackground] = KColorUtils::tint(_brushes.bg[KColorScheme::AlternateBackground].color(), tint, 0.4);
+        normalBackground = KColorUtils::tint(normalBackground, tint, 0.4);
+        alternateBackground = KColorUtils::tint(alternateBackground, tint, 0.4);
     }
 
-    // apply state adjustments
-    if (state != QPalette::Active || (state == QPalette::Inactive && !hasInactivePalette)) {
-        StateEffects effects(state, config);
-        for (auto &fg : _brushes.fg) {
-            fg = effects.brush(fg, _brushes.bg[KColorScheme::NormalBackground]);
-        }
-        for (auto &deco : _brushes.deco) {
-            deco = effects.brush(deco, _brushes.bg[KColorScheme::NormalBackground]);
-        }
-        _brushes.bg[KColorScheme::NormalBackground] = effects.brush(_brushes.bg[KColorScheme::NormalBackground]);
-        _brushes.bg[KColorScheme::AlternateBackground] = effects.brush(_brushes.bg[KColorScheme::AlternateBackground]);
+    // apply state adjustments, also on top of an explicit inactive palette
+    const StateEffects *effects = state == QPalette::Inactive ? data.inactiveEffects.get() : state == QPalette::Disabled ? data.disabledEffects.get() : nullptr;
+    if (effects) {
+        effects->apply(fg, normalBackground);
+        _decorationEffects = state == QPalette::Inactive ? data.inactiveEffects : data.disabledEffects;
+        _decorationEffectsBackground = normalBackground.rgba64();
+        std::array<QColor, 2> backgrounds = {normalBackground, alternateBackground};
+        effects->apply(backgrounds);
+        normalBackground = backgrounds[0];
+        alternateBackground = backgrounds[1];
     }
 
-    // calculated backgrounds
-    _brushes.bg[KColorScheme::ActiveBackground] =
-        KColorUtils::tint(_brushes.bg[KColorScheme::NormalBackground].color(), _brushes.fg[KColorScheme::ActiveText].color());
-    _brushes.bg[KColorScheme::LinkBackground] =
-        KColorUtils::tint(_brushes.bg[KColorScheme::NormalBackground].color(), _brushes.fg[KColorScheme::LinkText].color());
-    _brushes.bg[KColorScheme::VisitedBackground] =
-        KColorUtils::tint(_brushes.bg[KColorScheme::NormalBackground].color(), _brushes.fg[KColorScheme::VisitedText].color());
-    _brushes.bg[KColorScheme::NegativeBackground] =
-        KColorUtils::tint(_brushes.bg[KColorScheme::NormalBackground].color(), _brushes.fg[KColorScheme::NegativeText].color());
-    _brushes.bg[KColorScheme::NeutralBackground] =
-        KColorUtils::tint(_brushes.bg[KColorScheme::NormalBackground].color(), _brushes.fg[KColorScheme::NeutralText].color());
-    _brushes.bg[KColorScheme::PositiveBackground] =
-        KColorUtils::tint(_brushes.bg[KColorScheme::NormalBackground].color(), _brushes.fg[KColorScheme::PositiveText].color());
+    for (int i = 0; i < KColorScheme::NForegroundRoles; ++i) {
+        _colors.fg[i] = fg[i].rgba64();
+    }
+    for (int i = 0; i < KColorScheme::NDecorationRoles; ++i) {
+        _colors.deco[i] = deco[i].rgba64();
+    }
+    _colors.bg[KColorScheme::NormalBackground] = normalBackground.rgba64();
+    _colors.bg[KColorScheme::AlternateBackground] = alternateBackground.rgba64();
+
+    initShades();
 }
 
-void KColorSchemePrivate::initFromSystemPalette(QPalette::ColorGroup state, KColorScheme::ColorSet set)
+void KColorSchemePrivate::initDerivedColors() const
+{
+    std::call_once(_derivedColorsInitialized, [this] {
+        if (_decorationEffects) {
+            std::array<QColor, KColorScheme::NDecorationRoles> deco;
+            for (int i = 0; i < KColorScheme::NDecorationRoles; ++i) {
+                deco[i] = QColor(_colors.deco[i]);
+            }
+            _decorationEffects->apply(deco, QColor(_decorationEffectsBackground));
+            for (int i = 0; i < KColorScheme::NDecorationRoles; ++i) {
+                _colors.deco[i] = deco[i].rgba64();
+            }
+        }
+
+        // calculated backgrounds
+        const QColor normalBackground(_colors.bg[KColorScheme::NormalBackground]);
+        const auto tinted = [this, &normalBackground](KColorScheme::ForegroundRole role) {
+            return KColorUtils::tint(normalBackground, QColor(_colors.fg[role])).rgba64();
+        };
+        _colors.bg[KColorScheme::ActiveBackground] = tinted(KColorScheme::ActiveText);
+        _colors.bg[KColorScheme::LinkBackground] = tinted(KColorScheme::LinkText);
+        _colors.bg[KColorScheme::VisitedBackground] = tinted(KColorScheme::VisitedText);
+        _colors.bg[KColorScheme::NegativeBackground] = tinted(KColorScheme::NegativeText);
+        _colors.bg[KColorScheme::NeutralBackground] = tinted(KColorScheme::NeutralText);
+        _colors.bg[KColorScheme::PositiveBackground] = tinted(KColorScheme::PositiveText);
+    });
+}
+
+void KColorSchemePrivate::initFromSystemPalette(const QPalette &systemPalette, QPalette::ColorGroup state, KColorScheme::ColorSet set)
 {
     // Initialize the color scheme from the system palette. This is supposed
     // to be done if high-contrast mode is active (on Windows).
-    const QPalette systemPalette = qApp->palette();
-
     QColor foreground;
     QColor background;
     switch (set) {
@@ -443,39 +883,123 @@ void KColorSchemePrivate::initFromSystemPalette(QPalette::ColorGroup state, KCol
 
     _contrast = KColorScheme::contrastF({});
 
-    _brushes.fg[KColorScheme::NormalText] = foreground;
-    _brushes.fg[KColorScheme::InactiveText] = foreground;
-    _brushes.fg[KColorScheme::ActiveText] = foreground;
-    _brushes.fg[KColorScheme::LinkText] = systemPalette.color(state, QPalette::Link);
-    _brushes.fg[KColorScheme::VisitedText] = systemPalette.color(state, QPalette::LinkVisited);
-    _brushes.fg[KColorScheme::NegativeText] = foreground;
-    _brushes.fg[KColorScheme::NeutralText] = foreground;
-    _brushes.fg[KColorScheme::PositiveText] = foreground;
+    const QRgba64 fg = foreground.rgba64();
+    const QRgba64 bg = background.rgba64();
+    const QRgba64 highlight = systemPalette.color(state, QPalette::Highlight).rgba64();
 
-    _brushes.bg[KColorScheme::NormalBackground] = background;
-    _brushes.bg[KColorScheme::AlternateBackground] = systemPalette.color(state, QPalette::AlternateBase);
-    _brushes.bg[KColorScheme::ActiveBackground] = background;
-    _brushes.bg[KColorScheme::LinkBackground] = background;
-    _brushes.bg[KColorScheme::VisitedBackground] = background;
-    _brushes.bg[KColorScheme::NegativeBackground] = background;
-    _brushes.bg[KColorScheme::NeutralBackground] = background;
-    _brushes.bg[KColorScheme::PositiveBackground] = background;
+    _colors.fg.fill(fg);
+    _colors.fg[KColorScheme::LinkText] = systemPalette.color(state, QPalette::Link).rgba64();
+    _colors.fg[KColorScheme::VisitedText] = systemPalette.color(state, QPalette::LinkVisited).rgba64();
 
-    _brushes.deco[KColorScheme::FocusColor] = systemPalette.color(state, QPalette::Highlight);
-    _brushes.deco[KColorScheme::HoverColor] = systemPalette.color(state, QPalette::Highlight);
+    _colors.bg.fill(bg);
+    _colors.bg[KColorScheme::AlternateBackground] = systemPalette.color(state, QPalette::AlternateBase).rgba64();
+
+    _colors.deco.fill(highlight);
+
+    // nothing derived from the system palette
+    std::call_once(_derivedColorsInitialized, [] {});
+
+    initShades();
+}
+
+void KColorSchemePrivate::initShades()
+{
+    const auto shades = KColorScheme::shades(QColor(_colors.bg[KColorScheme::NormalBackground]), _contrast);
+    for (int role = 0; role < KColorScheme::NShadeRoles; ++role) {
+        _colors.shade[role] = shades[role].rgba64();
+    }
+}
+
+// BEGIN brush pool
+// Brushes are interned, so that schemes of the same colors share the data of their
+// brushes instead of each allocating its own
+class BrushPool
+{
+public:
+    // Sets brushes[i] to the brush of colors[i] for every i in indexes
+    template<std::size_t N>
+    void intern(std::array<QBrush, N> &brushes, const std::array<QRgba64, N> &colors, std::initializer_list<int> indexes)
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int i : indexes) {
+            brushes[i] = brush(colors[i]);
+        }
+    }
+
+    template<std::size_t N>
+    void intern(std::array<QBrush, N> &brushes, const std::array<QRgba64, N> &colors)
+    {
+        QMutexLocker locker(&m_mutex);
+        for (std::size_t i = 0; i < N; ++i) {
+            brushes[i] = brush(colors[i]);
+        }
+    }
+
+private:
+    // Brushes handed out keep their data when the pool is cleared
+    static constexpr qsizetype MaxBrushes = 1024;
+
+    QBrush brush(QRgba64 color)
+    {
+        auto it = m_brushes.constFind(quint64(color));
+        if (it == m_brushes.cend()) {
+            if (m_brushes.size() >= MaxBrushes) {
+                m_brushes.clear();
+            }
+            it = m_brushes.insert(quint64(color), QBrush(QColor(color)));
+        }
+        return *it;
+    }
+
+    QBasicMutex m_mutex;
+    QHash<quint64, QBrush> m_brushes;
+};
+
+Q_GLOBAL_STATIC(BrushPool, s_brushPool)
+// END brush pool
+
+void KColorSchemePrivate::initBrushes() const
+{
+    std::call_once(_brushesInitialized, [this] {
+        s_brushPool->intern(_brushes.fg, _colors.fg);
+        s_brushPool->intern(_brushes.bg, _colors.bg, {KColorScheme::NormalBackground, KColorScheme::AlternateBackground});
+    });
+}
+
+void KColorSchemePrivate::initDerivedBrushes() const
+{
+    std::call_once(_derivedBrushesInitialized, [this] {
+        initDerivedColors();
+        s_brushPool->intern(_brushes.bg,
+                            _colors.bg,
+                            {KColorScheme::ActiveBackground,
+                             KColorScheme::LinkBackground,
+                             KColorScheme::VisitedBackground,
+                             KColorScheme::NegativeBackground,
+                             KColorScheme::NeutralBackground,
+                             KColorScheme::PositiveBackground});
+        s_brushPool->intern(_brushes.deco, _colors.deco);
+    });
 }
 
 QBrush KColorSchemePrivate::background(KColorScheme::BackgroundRole role) const
 {
     if (role >= KColorScheme::NormalBackground && role < KColorScheme::NBackgroundRoles) {
+        if (role != KColorScheme::NormalBackground && role != KColorScheme::AlternateBackground) {
+            initDerivedBrushes();
+        } else {
+            initBrushes();
+        }
         return _brushes.bg[role];
     } else {
+        initBrushes();
         return _brushes.bg[KColorScheme::NormalBackground];
     }
 }
 
 QBrush KColorSchemePrivate::foreground(KColorScheme::ForegroundRole role) const
 {
+    initBrushes();
     if (role >= KColorScheme::NormalText && role < KColorScheme::NForegroundRoles) {
         return _brushes.fg[role];
     } else {
@@ -485,6 +1009,7 @@ QBrush KColorSchemePrivate::foreground(KColorScheme::ForegroundRole role) const
 
 QBrush KColorSchemePrivate::decoration(KColorScheme::DecorationRole role) const
 {
+    initDerivedBrushes();
     if (role >= KColorScheme::FocusColor && role < KColorScheme::NDecorationRoles) {
         return _brushes.deco[role];
     } else {
@@ -492,12 +1017,592 @@ QBrush KColorSchemePrivate::decoration(KColorScheme::DecorationRole role) const
     }
 }
 
+QColor KColorSchemePrivate::shade(KColorScheme::ShadeRole role) const
+{
+    if (role >= KColorScheme::LightShade && role < KColorScheme::NShadeRoles) {
+        return QColor(_colors.shade[role]);
+    } else {
+        return KColorScheme::shade(QColor(_colors.bg[KColorScheme::NormalBackground]), role, _contrast);
+    }
+}
+
 qreal KColorSchemePrivate::contrast() const
 {
     return _contrast;
 }
+
+bool KColorSchemePrivate::operator==(const KColorSchemePrivate &other) const
+{
+    if (this == &other) {
+        return true;
+    }
+    initDerivedColors();
+    other.initDerivedColors();
+    return _contrast == other._contrast && _colors == other._colors;
+}
 // END KColorSchemePrivate
 
+// BEGIN ResolvedScheme
+// Every set and state of one color scheme, resolved in a single pass over its config
+class ResolvedScheme
+{
+public:
+    explicit ResolvedScheme(const KSharedConfigPtr &config);
+
+    static bool contains(QPalette::ColorGroup state, KColorScheme::ColorSet set)
+    {
+        return state >= QPalette::Active && state < QPalette::NColorGroups && set >= KColorScheme::View && set < KColorScheme::NColorSets;
+    }
+
+    const QExplicitlySharedDataPointer<KColorSchemePrivate> &scheme(QPalette::ColorGroup state, KColorScheme::ColorSet set) const
+    {
+        Q_ASSERT(contains(state, set));
+        return m_schemes[state * KColorScheme::NColorSets + set];
+    }
+
+    using Schemes = std::array<QExplicitlySharedDataPointer<KColorSchemePrivate>, QPalette::NColorGroups * KColorScheme::NColorSets>;
+
+private:
+    Schemes m_schemes;
+};
+
+// BEGIN shared resolved schemes
+// Opt-in: the processes of a session share the schemes they resolved through files in $XDG_RUNTIME_DIR
+static bool sharedSchemesEnabled()
+{
+    static const bool enabled = qEnvironmentVariableIntValue("KCOLORSCHEME_SHARED_CACHE") > 0;
+    return enabled;
+}
+
+namespace
+{
+// "KCSR", bump the version whenever the layout of the file or of KColorSchemePrivate::Colors changes
+constexpr quint32 s_sharedSchemeMagic = 0x4B435352;
+constexpr quint32 s_sharedSchemeVersion = 1;
+
+/*
+ * A shared scheme file is this header, the source stamps of the scheme and one
+ * entry per state and set. The checksum covers everything after the header.
+ */
+struct SharedSchemeHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 entrySize;
+    quint32 entryCount;
+    quint32 stampsSize;
+    char checksum[20];
+};
+
+struct SharedSchemeEntry {
+    double contrast;
+    KColorSchemePrivate::Colors colors;
+};
+static_assert(std::is_trivially_copyable_v<SharedSchemeHeader> && std::is_trivially_copyable_v<SharedSchemeEntry>);
+}
+
+static QString sharedSchemePath(const KSharedConfigPtr &config)
+{
+    return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + QStringLiteral("/kcolorscheme/") + CompiledScheme::fileName(config)
+        + QStringLiteral(".kcsr");
+}
+
+static bool loadSharedScheme(const KSharedConfigPtr &config, ResolvedScheme::Schemes &schemes)
+{
+    const QByteArray stamps = CompiledScheme::sourceStamps(config, CompiledScheme::ForReading);
+    if (stamps.isEmpty()) {
+        return false;
+    }
+
+    QFile file(sharedSchemePath(config));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const qint64 size = file.size();
+    if (size != qint64(sizeof(SharedSchemeHeader) + stamps.size() + schemes.size() * sizeof(SharedSchemeEntry))) {
+        return false;
+    }
+    const uchar *mapped = file.map(0, size);
+    if (!mapped) {
+        return false;
+    }
+
+    SharedSchemeHeader header;
+    std::memcpy(&header, mapped, sizeof(header));
+    if (header.magic != s_sharedSchemeMagic || header.version != s_sharedSchemeVersion || header.entrySize != sizeof(SharedSchemeEntry)
+        || header.entryCount != schemes.size() || header.stampsSize != quint32(stamps.size())) {
+        return false;
+    }
+    const QByteArrayView body(mapped + sizeof(header), size - qint64(sizeof(header)));
+    if (QCryptographicHash::hash(body, QCryptographicHash::Sha1) != QByteArrayView(header.checksum, sizeof(header.checksum))) {
+        qCDebug(KCOLORSCHEME) << "Ignoring corrupt shared color scheme" << file.fileName();
+        return false;
+    }
+    if (body.first(stamps.size()) != stamps) {
+        // Stale, gets replaced by the next process resolving the scheme
+        return false;
+    }
+
+    const char *entries = body.data() + stamps.size();
+    for (std::size_t i = 0; i < schemes.size(); ++i) {
+        SharedSchemeEntry entry;
+        std::memcpy(&entry, entries + i * sizeof(SharedSchemeEntry), sizeof(SharedSchemeEntry));
+        schemes[i] = QExplicitlySharedDataPointer(new KColorSchemePrivate(entry.colors, entry.contrast));
+    }
+    return true;
+}
+
+/*
+ * Publishes schemes resolved from config's files as they were when stamps were taken.
+ * Nothing is published if the files changed since, schemes may be of either version.
+ */
+static void publishSharedScheme(const KSharedConfigPtr &config, const QByteArray &stamps, const ResolvedScheme::Schemes &schemes)
+{
+    if (stamps.isEmpty() || CompiledScheme::sourceStamps(config, CompiledScheme::ForWriting) != stamps) {
+        return;
+    }
+
+    QByteArray body = stamps;
+    for (const auto &scheme : schemes) {
+        SharedSchemeEntry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.contrast = scheme->contrast();
+        entry.colors = scheme->colors();
+        body.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    }
+
+    SharedSchemeHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = s_sharedSchemeMagic;
+    header.version = s_sharedSchemeVersion;
+    header.entrySize = sizeof(SharedSchemeEntry);
+    header.entryCount = schemes.size();
+    header.stampsSize = stamps.size();
+    const QByteArray checksum = QCryptographicHash::hash(body, QCryptographicHash::Sha1);
+    std::memcpy(header.checksum, checksum.constData(), sizeof(header.checksum));
+
+    const QString path = sharedSchemePath(config);
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        return;
+    }
+    // Replaces the file atomically, processes that mapped the old one keep reading it
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(body);
+    if (!file.commit()) {
+        qCDebug(KCOLORSCHEME) << "Could not write shared color scheme" << path << file.errorString();
+    }
+}
+// END shared resolved schemes
+
+ResolvedScheme::ResolvedScheme(const KSharedConfigPtr &config)
+{
+    const bool shared = config && sharedSchemesEnabled();
+    if (shared && loadSharedScheme(config, m_schemes)) {
+        return;
+    }
+
+    // Taken before reading, shared schemes are of the files as they are now
+    const QByteArray stamps = shared ? CompiledScheme::sourceStamps(config, CompiledScheme::ForWriting) : QByteArray();
+
+    std::optional<SchemeData> data;
+    QPalette systemPalette;
+    if (!stamps.isEmpty()) {
+        // config may have been read before the latest changes of its files, a shared
+        // scheme has to be read anew to be true of its stamps. The stamps are empty
+        // for configs with state of their own, those are never shared.
+        const KConfig fresh(config->name(), config->openFlags(), config->locationType());
+        data = parseSchemeData(fresh);
+    } else if (config) {
+        data = readSchemeData(config);
+    } else {
+        systemPalette = defaultSystemPalette();
+    }
+    for (int state = QPalette::Active; state < QPalette::NColorGroups; ++state) {
+        for (int set = KColorScheme::View; set < KColorScheme::NColorSets; ++set) {
+            const auto colorGroup = static_cast<QPalette::ColorGroup>(state);
+            const auto colorSet = static_cast<KColorScheme::ColorSet>(set);
+            m_schemes[state * KColorScheme::NColorSets + set] =
+                QExplicitlySharedDataPointer(data ? new KColorSchemePrivate(*data, colorGroup, colorSet)
+                                                : new KColorSchemePrivate(systemPalette, colorGroup, colorSet));
+        }
+    }
+
+    if (shared) {
+        publishSharedScheme(config, stamps, m_schemes);
+    }
+}
+// END ResolvedScheme
+
+// BEGIN KColorSchemeCache
+// Everything resolved from a config is shared between all users of the same
+// config. The cache is per thread, as KSharedConfig is.
+class KColorSchemeCache
+{
+public:
+    QExplicitlySharedDataPointer<KColorSchemePrivate> scheme(const KSharedConfigPtr &config, QPalette::ColorGroup state, KColorScheme::ColorSet set);
+    void insert(const KSharedConfigPtr &config, const std::shared_ptr<const ResolvedScheme> &scheme);
+    // Forgets everything resolved from config
+    void remove(const KSharedConfigPtr &config);
+
+    std::shared_ptr<const StateEffects> effects(const KSharedConfigPtr &config, QPalette::ColorGroup state);
+
+    struct Contrast {
+        qreal contrast;
+        qreal frameContrast;
+    };
+    // The contrast settings of the config, or of the application's scheme if it is null
+    Contrast contrast(const KSharedConfigPtr &config);
+
+private:
+    static constexpr std::size_t MaxConfigs = 8;
+
+    using Clock = std::chrono::steady_clock;
+    // How often the files of a cached config are checked for changes, lookups don't touch the disk
+    static constexpr Clock::duration CheckInterval = std::chrono::seconds(1);
+    // How long a config is read directly after its files changed, as it may still be reparsed
+    static constexpr Clock::duration SettleTime = std::chrono::seconds(2);
+
+    // Modification time and size of a file, -1 if it doesn't exist
+    using FileStamp = std::pair<qint64, qint64>;
+
+    struct Entry {
+        KSharedConfigPtr config;
+        // The files the config is read from and their stamps when last checked.
+        // Once one changes, the config may have been written and synced, or reparsed.
+        QStringList files;
+        std::vector<FileStamp> stamps;
+        Clock::time_point checked;
+        // Nothing resolved from the config is kept before then
+        Clock::time_point settled;
+        std::shared_ptr<const ResolvedScheme> scheme;
+        std::array<std::shared_ptr<const StateEffects>, QPalette::NColorGroups> effects;
+        std::optional<Contrast> contrast;
+    };
+
+    // Unsaved changes mean someone is editing the config, don't hand out stale colors
+    static bool isCacheable(const KSharedConfigPtr &config)
+    {
+        return config && !config->isDirty();
+    }
+
+    static QStringList configFiles(const KSharedConfigPtr &config);
+    static std::vector<FileStamp> fileStamps(const QStringList &files);
+
+    // Returns the entry for a cacheable config, adding an empty one if needed, or
+    // null if nothing resolved from the config can be kept. Only valid until the
+    // cache is used again.
+    Entry *entry(const KSharedConfigPtr &config);
+
+    static Contrast readContrast(const KSharedConfigPtr &config);
+
+    quint64 m_generation = 0;
+    std::vector<Entry> m_entries;
+
+    // Styles ask for the contrast of the application's scheme on every paint, so
+    // this must not need to look up the scheme's config to be answered
+    quint64 m_defaultContrastGeneration = 0;
+    Contrast m_defaultContrast = {};
+};
+
+QStringList KColorSchemeCache::configFiles(const KSharedConfigPtr &config)
+{
+    QStringList files;
+    const QString name = config->name();
+    if (QDir::isAbsolutePath(name)) {
+        // Resources never change
+        if (!name.startsWith(QLatin1Char(':'))) {
+            files << name;
+        }
+    } else if (!name.isEmpty()) {
+        // Where sync() would write the config, even if it doesn't exist yet
+        files << QStandardPaths::writableLocation(config->locationType()) + QLatin1Char('/') + name;
+        files << QStandardPaths::locateAll(config->locationType(), name);
+    }
+    if (config->openFlags() & KConfig::IncludeGlobals) {
+        files << QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation) + QStringLiteral("/kdeglobals");
+        files << QStandardPaths::locateAll(QStandardPaths::GenericConfigLocation, QStringLiteral("kdeglobals"));
+    }
+    files.removeDuplicates();
+    return files;
+}
+
+std::vector<KColorSchemeCache::FileStamp> KColorSchemeCache::fileStamps(const QStringList &files)
+{
+    std::vector<FileStamp> stamps;
+    stamps.reserve(files.size());
+    for (const QString &file : files) {
+        const QFileInfo info(file);
+        stamps.emplace_back(info.exists() ? FileStamp{info.lastModified(QTimeZone::UTC).toMSecsSinceEpoch(), info.size()} : FileStamp{-1, -1});
+    }
+    return stamps;
+}
+
+KColorSchemeCache::Entry *KColorSchemeCache::entry(const KSharedConfigPtr &config)
+{
+    if (!isCacheable(config)) {
+        return nullptr;
+    }
+
+    const quint64 generation = colorSchemeGeneration();
+    if (m_generation != generation) {
+        m_entries.clear();
+        m_generation = generation;
+    }
+
+    // Only keep configs alive as long as someone else does, so that reopening one reads it again
+    std::erase_if(m_entries, [](const Entry &entry) {
+        return entry.config->ref.loadRelaxed() == 1;
+    });
+
+    auto it = std::find_if(m_entries.begin(), m_entries.end(), [&config](const Entry &entry) {
+        return entry.config == config;
+    });
+    const Clock::time_point now = Clock::now();
+    if (it != m_entries.end()) {
+        if (now - it->checked >= CheckInterval) {
+            std::vector<FileStamp> stamps = fileStamps(it->files);
+            if (stamps != it->stamps) {
+                // There is no telling when the config picks up the change, so it is
+                // read directly for a while before it is cached again
+                *it = Entry{config, std::move(it->files), std::move(stamps), now, now + SettleTime, {}, {}, {}};
+            }
+            it->checked = now;
+        }
+        return now < it->settled ? nullptr : &*it;
+    }
+    if (m_entries.size() >= MaxConfigs) {
+        m_entries.erase(m_entries.begin());
+    }
+    QStringList files = configFiles(config);
+    std::vector<FileStamp> stamps = fileStamps(files);
+    return &m_entries.emplace_back(Entry{config, std::move(files), std::move(stamps), now, now, {}, {}, {}});
+}
+
+void KColorSchemeCache::insert(const KSharedConfigPtr &config, const std::shared_ptr<const ResolvedScheme> &scheme)
+{
+    if (Entry *entry = this->entry(config)) {
+        entry->scheme = scheme;
+    }
+}
+
+void KColorSchemeCache::remove(const KSharedConfigPtr &config)
+{
+    std::erase_if(m_entries, [&config](const Entry &entry) {
+        return entry.config == config;
+    });
+}
+
+QExplicitlySharedDataPointer<KColorSchemePrivate>
+KColorSchemeCache::scheme(const KSharedConfigPtr &config, QPalette::ColorGroup state, KColorScheme::ColorSet set)
+{
+    Entry *entry = ResolvedScheme::contains(state, set) ? this->entry(config) : nullptr;
+    if (!entry) {
+        if (config) {
+            return QExplicitlySharedDataPointer(new KColorSchemePrivate(readSchemeData(config), state, set));
+        }
+        return QExplicitlySharedDataPointer(new KColorSchemePrivate(defaultSystemPalette(), state, set));
+    }
+
+    if (const auto &resolved = entry->scheme) {
+        return resolved->scheme(state, set);
+    }
+    // Resolving reads the state effects through the cache, so only store the result afterwards
+    const auto resolved = std::make_shared<const ResolvedScheme>(config);
+    insert(config, resolved);
+    return resolved->scheme(state, set);
+}
+
+std::shared_ptr<const StateEffects> KColorSchemeCache::effects(const KSharedConfigPtr &config, QPalette::ColorGroup state)
+{
+    Entry *entry = state >= QPalette::Active && state < QPalette::NColorGroups ? this->entry(config) : nullptr;
+    if (!entry) {
+        return std::make_shared<const StateEffects>(state, config);
+    }
+
+    auto &effects = entry->effects[state];
+    if (effects) {
+        s_effectsCacheHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        s_effectsCacheMisses.fetch_add(1, std::memory_order_relaxed);
+        effects = std::make_shared<const StateEffects>(state, config);
+    }
+    return effects;
+}
+
+KColorSchemeCache::Contrast KColorSchemeCache::readContrast(const KSharedConfigPtr &config)
+{
+    // Keep the frame contrast default in sync with Kirigami platformtheme.cpp
+    if (!config) {
+        return {0.7, 0.2};
+    }
+    const KConfigGroup g(config, QStringLiteral("KDE"));
+    return {0.1 * g.readEntry("contrast", 7), std::clamp(g.readEntry("frameContrast", 0.2), 0.0, 1.0)};
+}
+
+KColorSchemeCache::Contrast KColorSchemeCache::contrast(const KSharedConfigPtr &config)
+{
+    if (!config) {
+        const quint64 generation = colorSchemeGeneration();
+        if (m_defaultContrastGeneration != generation) {
+            m_defaultContrast = readContrast(defaultConfig());
+            m_defaultContrastGeneration = generation;
+        }
+        return m_defaultContrast;
+    }
+
+    Entry *entry = this->entry(config);
+    if (!entry) {
+        return readContrast(config);
+    }
+    auto &contrast = entry->contrast;
+    if (!contrast) {
+        contrast = readContrast(config);
+    }
+    return *contrast;
+}
+
+static thread_local KColorSchemeCache s_schemeCache;
+
+std::shared_ptr<const StateEffects> StateEffects::forConfig(QPalette::ColorGroup state, const KSharedConfigPtr &config)
+{
+    if (!config) {
+        // Colors from the system palette don't get any effects applied
+        static const auto noEffects = std::make_shared<const StateEffects>();
+        return noEffects;
+    }
+    return s_schemeCache.effects(config, state);
+}
+// END KColorSchemeCache
+
+// BEGIN default resolved scheme
+// The application's scheme, resolved once for all threads. Threads other than
+// the GUI thread only read this snapshot, so they neither touch the
+// application object nor keep configs of their own open for it.
+class KColorSchemeSnapshotPrivate
+{
+public:
+    quint64 generation;
+    std::shared_ptr<const ResolvedScheme> scheme;
+};
+
+// Guarded by s_defaultSchemeMutex
+static std::shared_ptr<const KColorSchemeSnapshotPrivate> s_defaultSnapshot;
+
+static void publishDefaultResolvedScheme(quint64 generation, const std::shared_ptr<const ResolvedScheme> &scheme)
+{
+    auto snapshot = std::make_shared<const KColorSchemeSnapshotPrivate>(KColorSchemeSnapshotPrivate{generation, scheme});
+    QMutexLocker locker(&s_defaultSchemeMutex);
+    // Don't replace a snapshot of a later change
+    if (!s_defaultSnapshot || generation >= s_defaultSnapshot->generation) {
+        s_defaultSnapshot = std::move(snapshot);
+    }
+}
+
+// Only the GUI thread resolves the application's scheme, its config is the one kept up to date
+static bool resolvesDefaultScheme()
+{
+    return !qApp || QThread::isMainThread();
+}
+
+// Whether the colors of a scheme are still those of the other, as resolved before
+static bool isSameColorScheme(const DefaultColorScheme &scheme, const DefaultColorScheme &other)
+{
+    if (scheme.path != other.path || scheme.useSystemPalette != other.useSystemPalette) {
+        return false;
+    }
+    if (scheme.useSystemPalette) {
+        return scheme.systemPalette == other.systemPalette;
+    }
+    // The application palette changing to the one made from the scheme announces it
+    if (other.palette && QThread::isMainThread()) {
+        const QPalette applicationPalette = QGuiApplication::palette();
+        if (other.palette->resolve(applicationPalette) == applicationPalette) {
+            return true;
+        }
+    }
+    // The system scheme follows the global settings, which may have been reparsed.
+    // Files need stamps to tell, only the schemes built into resources never change.
+    if (scheme.path.isEmpty()) {
+        return false;
+    }
+    return scheme.path.startsWith(QLatin1Char(':')) || (!scheme.stamps.isEmpty() && scheme.stamps == other.stamps);
+}
+
+void updateDefaultColorScheme()
+{
+    auto scheme = readDefaultColorScheme(qApp->property("KDE_COLOR_SCHEME_PATH").toString());
+    // The same config defaultConfig() returns on this thread, it is kept open there
+    const KSharedConfigPtr config = scheme->useSystemPalette ? KSharedConfigPtr() : KSharedConfig::openConfig(scheme->path);
+    if (config) {
+        scheme->stamps = CompiledScheme::sourceStamps(config, CompiledScheme::ForReading);
+    }
+    quint64 generation;
+    {
+        QMutexLocker locker(&s_defaultSchemeMutex);
+        // e.g. the platform theme applying the palette of a scheme that was just activated,
+        // which must not drop the snapshot published along with it
+        if (s_defaultSnapshot && s_defaultScheme && isSameColorScheme(*scheme, *s_defaultScheme)) {
+            return;
+        }
+        s_defaultScheme = std::move(scheme);
+        invalidateColorSchemeCaches();
+        generation = colorSchemeGeneration();
+    }
+
+    // Resolving asks for the default contrast, so don't hold the lock meanwhile
+    const auto resolved = std::make_shared<const ResolvedScheme>(config);
+    if (config) {
+        s_schemeCache.insert(config, resolved);
+    }
+    publishDefaultResolvedScheme(generation, resolved);
+}
+
+static std::shared_ptr<const KColorSchemeSnapshotPrivate> defaultSnapshot()
+{
+    // Once a thread has the snapshot of the current generation, it takes no locks
+    static thread_local std::shared_ptr<const KColorSchemeSnapshotPrivate> snapshot;
+
+    const quint64 generation = colorSchemeGeneration();
+    if (snapshot && snapshot->generation == generation) {
+        return snapshot;
+    }
+
+    {
+        QMutexLocker locker(&s_defaultSchemeMutex);
+        if (s_defaultSnapshot && s_defaultSnapshot->generation == generation) {
+            snapshot = s_defaultSnapshot;
+            return snapshot;
+        }
+        // The GUI thread publishes the next snapshot right after bumping the generation,
+        // until then the latest one is still the best there is
+        if (s_defaultSnapshot && !resolvesDefaultScheme()) {
+            return s_defaultSnapshot;
+        }
+    }
+
+    // Only used before anything was published, a config of another thread is
+    // never reparsed, so what it resolves is not shared beyond this generation
+    const auto scheme = currentDefaultColorScheme();
+    const auto resolved = std::make_shared<const ResolvedScheme>(scheme->useSystemPalette ? KSharedConfigPtr() : KSharedConfig::openConfig(scheme->path));
+    if (resolvesDefaultScheme()) {
+        publishDefaultResolvedScheme(generation, resolved);
+    }
+    snapshot = std::make_shared<const KColorSchemeSnapshotPrivate>(KColorSchemeSnapshotPrivate{generation, resolved});
+    return snapshot;
+}
+
+static QExplicitlySharedDataPointer<KColorSchemePrivate> resolveScheme(const KSharedConfigPtr &config, QPalette::ColorGroup state, KColorScheme::ColorSet set)
+{
+    if (!config && ResolvedScheme::contains(state, set)) {
+        return defaultSnapshot()->scheme->scheme(state, set);
+    }
+    return s_schemeCache.scheme(config ? config : defaultConfig(), state, set);
+}
+// END default resolved scheme
+
 // BEGIN KColorScheme
 KColorScheme::KColorScheme(const KColorScheme &) = default;
 KColorScheme &KColorScheme::operator=(const KColorScheme &) = default;
@@ -506,36 +1611,39 @@ KColorScheme &KColorScheme::operator=(KColorScheme &&) = default;
 KColorScheme::~KColorScheme() = default;
 
 KColorScheme::KColorScheme(QPalette::ColorGroup state, ColorSet set, KSharedConfigPtr config)
-    : d(new KColorSchemePrivate(config ? config : defaultConfig(), state, set))
+    : d(resolveScheme(config, state, set))
+{
+}
+
+KColorScheme::KColorScheme(const QExplicitlySharedDataPointer<KColorSchemePrivate> &d)
+    : d(d)
 {
 }
 
 bool KColorScheme::operator==(const KColorScheme &other) const
 {
-    return d == other.d || (d->_contrast == other.d->_contrast && d->_brushes == other.d->_brushes);
+    return d == other.d || *d == *other.d;
 }
 
 // static
 qreal KColorScheme::contrastF(const KSharedConfigPtr &config)
 {
-    KSharedConfigPtr conf = config ? config : defaultConfig();
-    if (!conf) {
-        return 0.7;
-    }
-    KConfigGroup g(conf, QStringLiteral("KDE"));
-    return 0.1 * g.readEntry("contrast", 7);
+    return s_schemeCache.contrast(config).contrast;
 }
 
 qreal KColorScheme::frameContrast(const KSharedConfigPtr &config)
 {
-    // Keep this in sync with Kirigami platformtheme.cpp
-    const qreal default_value = 0.2;
-    KSharedConfigPtr conf = config ? config : defaultConfig();
-    if (!conf) {
-        return default_value;
-    }
-    KConfigGroup g(conf, QStringLiteral("KDE"));
-    return std::clamp(g.readEntry("frameContrast", default_value), 0.0, 1.0);
+    return s_schemeCache.contrast(config).frameContrast;
+}
+
+void KColorScheme::applyStateEffects(QSpan<QColor> colors, QPalette::ColorGroup state, const QColor &background, const KSharedConfigPtr &config)
+{
+    StateEffects::forConfig(state, config ? config : defaultConfig())->apply(colors, background);
+}
+
+quint64 KColorScheme::generation()
+{
+    return colorSchemeGeneration();
 }
 
 QBrush KColorScheme::background(BackgroundRole role) const
@@ -555,7 +1663,7 @@ QBrush KColorScheme::decoration(DecorationRole role) const
 
 QColor KColorScheme::shade(ShadeRole role) const
 {
-    return shade(background().color(), role, d->contrast());
+    return d->shade(role);
 }
 
 QColor KColorScheme::shade(const QColor &color, ShadeRole role)
@@ -563,24 +1671,22 @@ QColor KColorScheme::shade(const QColor &color, ShadeRole role)
     return shade(color, role, KColorScheme::contrastF());
 }
 
-QColor KColorScheme::shade(const QColor &color, ShadeRole role, qreal contrast, qreal chromaAdjust)
+// The amount by which shade() shades a color of luma y
+static qreal shadeAmount(KColorScheme::ShadeRole role, qreal y, qreal contrast)
 {
-    // nan -> 1.0
-    contrast = (1.0 > contrast ? (-1.0 < contrast ? contrast : -1.0) : 1.0);
-    qreal y = KColorUtils::luma(color);
     qreal yi = 1.0 - y;
 
     // handle very dark colors (base, mid, dark, shadow == midlight, light)
     if (y < 0.006) {
         switch (role) {
         case KColorScheme::LightShade:
-            return KColorUtils::shade(color, 0.05 + 0.95 * contrast, chromaAdjust);
+            return 0.05 + 0.95 * contrast;
         case KColorScheme::MidShade:
-            return KColorUtils::shade(color, 0.01 + 0.20 * contrast, chromaAdjust);
+            return 0.01 + 0.20 * contrast;
         case KColorScheme::DarkShade:
-            return KColorUtils::shade(color, 0.02 + 0.40 * contrast, chromaAdjust);
+            return 0.02 + 0.40 * contrast;
         default:
-            return KColorUtils::shade(color, 0.03 + 0.60 * contrast, chromaAdjust);
+            return 0.03 + 0.60 * contrast;
         }
     }
 
@@ -588,13 +1694,13 @@ QColor KColorScheme::shade(const QColor &color, ShadeRole role, qreal contrast,
     if (y > 0.93) {
         switch (role) {
         case KColorScheme::MidlightShade:
-            return KColorUtils::shade(color, -0.02 - 0.20 * contrast, chromaAdjust);
+            return -0.02 - 0.20 * contrast;
         case KColorScheme::DarkShade:
-            return KColorUtils::shade(color, -0.06 - 0.60 * contrast, chromaAdjust);
+            return -0.06 - 0.60 * contrast;
         case KColorScheme::ShadowShade:
-            return KColorUtils::shade(color, -0.10 - 0.90 * contrast, chromaAdjust);
+            return -0.10 - 0.90 * contrast;
         default:
-            return KColorUtils::shade(color, -0.04 - 0.40 * contrast, chromaAdjust);
+            return -0.04 - 0.40 * contrast;
         }
     }
 
@@ -603,15 +1709,59 @@ QColor KColorScheme::shade(const QColor &color, ShadeRole role, qreal contrast,
     qreal darkAmount = (-y) * (0.55 + contrast * 0.35);
     switch (role) {
     case KColorScheme::LightShade:
-        return KColorUtils::shade(color, lightAmount, chromaAdjust);
+        return lightAmount;
     case KColorScheme::MidlightShade:
-        return KColorUtils::shade(color, (0.15 + 0.35 * yi) * lightAmount, chromaAdjust);
+        return (0.15 + 0.35 * yi) * lightAmount;
     case KColorScheme::MidShade:
-        return KColorUtils::shade(color, (0.35 + 0.15 * y) * darkAmount, chromaAdjust);
-    case KColorScheme::DarkShade:
-        return KColorUtils::shade(color, darkAmount, chromaAdjust);
+        return (0.35 + 0.15 * y) * darkAmount;
     default:
-        return KColorUtils::darken(KColorUtils::shade(color, darkAmount, chromaAdjust), 0.5 + 0.3 * y);
+        return darkAmount;
+    }
+}
+
+// shade() for a color whose luma is already known, with contrast already bounded
+static QColor shadeWithLuma(const QColor &color, KColorScheme::ShadeRole role, qreal y, qreal contrast, qreal chromaAdjust)
+{
+    const QColor shaded = KColorUtils::shade(color, shadeAmount(role, y, contrast), chromaAdjust);
+    // shadows of everything but very dark and very light colors get darkened further
+    if (y >= 0.006 && y <= 0.93 && role != KColorScheme::LightShade && role != KColorScheme::MidlightShade && role != KColorScheme::MidShade
+        && role != KColorScheme::DarkShade) {
+        return KColorUtils::darken(shaded, 0.5 + 0.3 * y);
+    }
+    return shaded;
+}
+
+static qreal boundedContrast(qreal contrast)
+{
+    // nan -> 1.0
+    return (1.0 > contrast ? (-1.0 < contrast ? contrast : -1.0) : 1.0);
+}
+
+QColor KColorScheme::shade(const QColor &color, ShadeRole role, qreal contrast, qreal chromaAdjust)
+{
+    return shadeWithLuma(color, role, KColorUtils::luma(color), boundedContrast(contrast), chromaAdjust);
+}
+
+std::array<QColor, KColorScheme::NShadeRoles> KColorScheme::shades(const QColor &color, qreal contrast, qreal chromaAdjust)
+{
+    contrast = boundedContrast(contrast);
+    const qreal y = KColorUtils::luma(color);
+
+    std::array<QColor, NShadeRoles> result;
+    for (int role = 0; role < NShadeRoles; ++role) {
+        result[role] = shadeWithLuma(color, ShadeRole(role), y, contrast, chromaAdjust);
+    }
+    return result;
+}
+
+void KColorScheme::shade(QSpan<const QColor> colors, QSpan<QColor> shaded, ShadeRole role, qreal contrast, qreal chromaAdjust)
+{
+    Q_ASSERT(shaded.size() >= colors.size());
+    contrast = boundedContrast(contrast);
+
+    const qsizetype count = std::min(colors.size(), shaded.size());
+    for (qsizetype i = 0; i < count; ++i) {
+        shaded[i] = shadeWithLuma(colors[i], role, KColorUtils::luma(colors[i]), contrast, chromaAdjust);
     }
 }
 
@@ -653,45 +1803,185 @@ bool KColorScheme::isColorSetSupported(const KSharedConfigPtr &config, KColorSch
     return false;
 }
 
-QPalette KColorScheme::createApplicationPalette(const KSharedConfigPtr &config)
+static QPalette applicationPalette(const ResolvedScheme &resolved)
 {
     static const QPalette::ColorGroup states[QPalette::NColorGroups] = {QPalette::Active, QPalette::Inactive, QPalette::Disabled};
 
     // TT thinks tooltips shouldn't use active, so we use our active colors for all states
-    KColorScheme schemeTooltip(QPalette::Active, KColorScheme::Tooltip, config);
+    const auto &schemeTooltip = resolved.scheme(QPalette::Active, KColorScheme::Tooltip);
 
     QPalette palette;
     for (auto state : states) {
-        KColorScheme schemeView(state, KColorScheme::View, config);
-        KColorScheme schemeWindow(state, KColorScheme::Window, config);
-        KColorScheme schemeButton(state, KColorScheme::Button, config);
-        KColorScheme schemeSelection(state, KColorScheme::Selection, config);
-
-        palette.setBrush(state, QPalette::WindowText, schemeWindow.foreground());
-        palette.setBrush(state, QPalette::Window, schemeWindow.background());
-        palette.setBrush(state, QPalette::Base, schemeView.background());
-        palette.setBrush(state, QPalette::Text, schemeView.foreground());
-        palette.setBrush(state, QPalette::Button, schemeButton.background());
-        palette.setBrush(state, QPalette::ButtonText, schemeButton.foreground());
-        palette.setBrush(state, QPalette::Highlight, schemeSelection.background());
-        palette.setBrush(state, QPalette::HighlightedText, schemeSelection.foreground());
-        palette.setBrush(state, QPalette::ToolTipBase, schemeTooltip.background());
-        palette.setBrush(state, QPalette::ToolTipText, schemeTooltip.foreground());
-        palette.setBrush(state, QPalette::PlaceholderText, schemeView.foreground(KColorScheme::InactiveText));
-        palette.setBrush(state, QPalette::Accent, schemeSelection.background());
-
-        palette.setColor(state, QPalette::Light, schemeWindow.shade(KColorScheme::LightShade));
-        palette.setColor(state, QPalette::Midlight, schemeWindow.shade(KColorScheme::MidlightShade));
-        palette.setColor(state, QPalette::Mid, schemeWindow.shade(KColorScheme::MidShade));
-        palette.setColor(state, QPalette::Dark, schemeWindow.shade(KColorScheme::DarkShade));
-        palette.setColor(state, QPalette::Shadow, schemeWindow.shade(KColorScheme::ShadowShade));
-
-        palette.setBrush(state, QPalette::AlternateBase, schemeView.background(KColorScheme::AlternateBackground));
-        palette.setBrush(state, QPalette::Link, schemeView.foreground(KColorScheme::LinkText));
-        palette.setBrush(state, QPalette::LinkVisited, schemeView.foreground(KColorScheme::VisitedText));
+        const auto &schemeView = resolved.scheme(state, KColorScheme::View);
+        const auto &schemeWindow = resolved.scheme(state, KColorScheme::Window);
+        const auto &schemeButton = resolved.scheme(state, KColorScheme::Button);
+        const auto &schemeSelection = resolved.scheme(state, KColorScheme::Selection);
+
+        palette.setBrush(state, QPalette::WindowText, schemeWindow->foreground(KColorScheme::NormalText));
+        palette.setBrush(state, QPalette::Window, schemeWindow->background(KColorScheme::NormalBackground));
+        palette.setBrush(state, QPalette::Base, schemeView->background(KColorScheme::NormalBackground));
+        palette.setBrush(state, QPalette::Text, schemeView->foreground(KColorScheme::NormalText));
+        palette.setBrush(state, QPalette::Button, schemeButton->background(KColorScheme::NormalBackground));
+        palette.setBrush(state, QPalette::ButtonText, schemeButton->foreground(KColorScheme::NormalText));
+        palette.setBrush(state, QPalette::Highlight, schemeSelection->background(KColorScheme::NormalBackground));
+        palette.setBrush(state, QPalette::HighlightedText, schemeSelection->foreground(KColorScheme::NormalText));
+        palette.setBrush(state, QPalette::ToolTipBase, schemeTooltip->background(KColorScheme::NormalBackground));
+        palette.setBrush(state, QPalette::ToolTipText, schemeTooltip->foreground(KColorScheme::NormalText));
+        palette.setBrush(state, QPalette::PlaceholderText, schemeView->foreground(KColorScheme::InactiveText));
+        palette.setBrush(state, QPalette::Accent, schemeSelection->background(KColorScheme::NormalBackground));
+
+        palette.setColor(state, QPalette::Light, schemeWindow->shade(KColorScheme::LightShade));
+        palette.setColor(state, QPalette::Midlight, schemeWindow->shade(KColorScheme::MidlightShade));
+        palette.setColor(state, QPalette::Mid, schemeWindow->shade(KColorScheme::MidShade));
+        palette.setColor(state, QPalette::Dark, schemeWindow->shade(KColorScheme::DarkShade));
+        palette.setColor(state, QPalette::Shadow, schemeWindow->shade(KColorScheme::ShadowShade));
+
+        palette.setBrush(state, QPalette::AlternateBase, schemeView->background(KColorScheme::AlternateBackground));
+        palette.setBrush(state, QPalette::Link, schemeView->foreground(KColorScheme::LinkText));
+        palette.setBrush(state, QPalette::LinkVisited, schemeView->foreground(KColorScheme::VisitedText));
     }
 
     return palette;
 }
 
+QPalette KColorScheme::createApplicationPalette(const KSharedConfigPtr &config)
+{
+    // This is called whenever a scheme gets (re)applied, possibly after the config was reparsed.
+    // Resolve everything anew and share the result with all KColorSchemes created from now on.
+    const KSharedConfigPtr conf = config ? config : defaultConfig();
+    if (conf != defaultConfig()) {
+        // e.g. a preview, the application's scheme stays as it is
+        s_schemeCache.remove(conf);
+        const auto resolved = std::make_shared<const ResolvedScheme>(conf);
+        s_schemeCache.insert(conf, resolved);
+        return applicationPalette(*resolved);
+    }
+
+    const auto current = currentDefaultColorScheme();
+    auto scheme = std::make_shared<DefaultColorScheme>(*current);
+    scheme->stamps = CompiledScheme::sourceStamps(conf, CompiledScheme::ForReading);
+
+    invalidateColorSchemeCaches();
+    const quint64 generation = colorSchemeGeneration();
+    const auto resolved = std::make_shared<const ResolvedScheme>(conf);
+    s_schemeCache.insert(conf, resolved);
+    publishDefaultResolvedScheme(generation, resolved);
+
+    // The palette is usually applied right away, which needs no resolving again
+    const QPalette palette = applicationPalette(*resolved);
+    scheme->palette = palette;
+    {
+        QMutexLocker locker(&s_defaultSchemeMutex);
+        if (s_defaultScheme == current) {
+            s_defaultScheme = std::move(scheme);
+        }
+    }
+    return palette;
+}
+
 // END KColorScheme
+
+// BEGIN KColorSchemeSnapshot
+KColorSchemeSnapshot::KColorSchemeSnapshot(const KColorSchemeSnapshot &) = default;
+KColorSchemeSnapshot &KColorSchemeSnapshot::operator=(const KColorSchemeSnapshot &) = default;
+KColorSchemeSnapshot::KColorSchemeSnapshot(KColorSchemeSnapshot &&) = default;
+KColorSchemeSnapshot &KColorSchemeSnapshot::operator=(KColorSchemeSnapshot &&) = default;
+KColorSchemeSnapshot::~KColorSchemeSnapshot() = default;
+
+KColorSchemeSnapshot::KColorSchemeSnapshot(std::shared_ptr<const KColorSchemeSnapshotPrivate> &&d)
+    : d(std::move(d))
+{
+}
+
+KColorSchemeSnapshot KColorSchemeSnapshot::current()
+{
+    return KColorSchemeSnapshot(defaultSnapshot());
+}
+
+quint64 KColorSchemeSnapshot::generation() const
+{
+    return d->generation;
+}
+
+bool KColorSchemeSnapshot::isCurrent() const
+{
+    return d->generation == colorSchemeGeneration();
+}
+
+KColorScheme KColorSchemeSnapshot::scheme(QPalette::ColorGroup state, KColorScheme::ColorSet set) const
+{
+    if (!ResolvedScheme::contains(state, set)) {
+        return KColorScheme(state, set);
+    }
+    return KColorScheme(d->scheme->scheme(state, set));
+}
+// END KColorSchemeSnapshot
+
+// BEGIN scheme activation
+class PreparedColorScheme
+{
+public:
+    QString path;
+    // Null when resetting to the system scheme
+    std::shared_ptr<const ResolvedScheme> scheme;
+    // Of the files as they were before resolving
+    QByteArray stamps;
+};
+
+std::shared_ptr<const PreparedColorScheme> prepareDefaultColorScheme(const QString &path)
+{
+    auto prepared = std::make_shared<PreparedColorScheme>();
+    prepared->path = path;
+    if (!path.isEmpty()) {
+        // The config is only used on this thread, like any KSharedConfig
+        const KSharedConfigPtr config = KSharedConfig::openConfig(path);
+        prepared->stamps = CompiledScheme::sourceStamps(config, CompiledScheme::ForReading);
+        prepared->scheme = std::make_shared<const ResolvedScheme>(config);
+    }
+    return prepared;
+}
+
+void activateDefaultColorScheme(const std::shared_ptr<const PreparedColorScheme> &prepared)
+{
+    const QString &path = prepared->path;
+    if (!prepared->scheme) {
+        // Both changes lead to the same scheme, resolve it once for them
+        s_announcingScheme = true;
+        qApp->setProperty("KDE_COLOR_SCHEME_PATH", path);
+        qApp->setPalette(QPalette());
+        s_announcingScheme = false;
+        updateDefaultColorScheme();
+        return;
+    }
+
+    // Everything was resolved before publishing, so that other threads switch
+    // over to the new scheme in one step and never have to resolve it themselves
+    const QPalette palette = applicationPalette(*prepared->scheme);
+    auto scheme = readDefaultColorScheme(path);
+    scheme->stamps = prepared->stamps;
+    scheme->palette = palette;
+    {
+        QMutexLocker locker(&s_defaultSchemeMutex);
+        s_defaultScheme = std::move(scheme);
+        invalidateColorSchemeCaches();
+        s_defaultSnapshot = std::make_shared<const KColorSchemeSnapshotPrivate>(KColorSchemeSnapshotPrivate{colorSchemeGeneration(), prepared->scheme});
+    }
+
+    // Let everyone else know, the property needs to be set before the palette
+    // changes as it is checked upon the ApplicationPaletteChange event
+    s_announcingScheme = true;
+    qApp->setProperty("KDE_COLOR_SCHEME_PATH", path);
+    qApp->setPalette(palette);
+    s_announcingScheme = false;
+}
+
+void activateDefaultColorScheme(const QString &path)
+{
+    const auto prepared = prepareDefaultColorScheme(path);
+    activateDefaultColorScheme(prepared);
+    if (prepared->scheme) {
+        // Resolved on this thread, so explicit users of the config can share it
+        s_schemeCache.insert(KSharedConfig::openConfig(path), prepared->scheme);
+    }
+}
+// END scheme activation
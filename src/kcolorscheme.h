@@ -14,6 +14,9 @@
 #include <QExplicitlySharedDataPointer>
 
 #include <QPalette>
+#include <QSpan>
+
+#include <array>
 
 class QColor;
 class QBrush;
@@ -48,7 +51,15 @@ class KColorSchemePrivate;
  * are provided. These are KColorScheme::adjustBackground and its sister
  * KColorScheme::adjustForeground, and the helper class KStatefulBrush.
  *
- * \sa KColorScheme::ColorSet, KColorScheme::ForegroundRole,
+ * KColorScheme can be constructed and used from any thread, e.g. to render
+ * on a thread pool. Without a config, all threads share an immutable snapshot
+ * of the application's color scheme that is resolved once per scheme change,
+ * and reading it takes no locks. A config passed explicitly must belong to the
+ * calling thread, like any KSharedConfig. Code that needs several colors to
+ * match while the scheme may change, e.g. for the duration of a frame, should
+ * take a KColorSchemeSnapshot.
+ *
+ * \sa KColorSchemeSnapshot, KColorScheme::ColorSet, KColorScheme::ForegroundRole,
  * KColorScheme::BackgroundRole, KColorScheme::DecorationRole,
  * KColorScheme::ShadeRole
  */
@@ -350,6 +361,30 @@ public:
      */
     static QColor shade(const QColor &, ShadeRole, qreal contrast, qreal chromaAdjust = 0.0);
 
+    /*!
+     * Retrieve every shade of the specified base color at once, indexed by
+     * ShadeRole. The result is the same as calling shade() for each role,
+     * but the luma of the base color is only computed once.
+     *
+     * \a contrast and \a chromaAdjust are used as in shade().
+     *
+     * \since 6.29
+     */
+    static std::array<QColor, NShadeRoles> shades(const QColor &color, qreal contrast, qreal chromaAdjust = 0.0);
+
+    /*!
+     * Retrieve the requested shade of many base colors at once, e.g. for
+     * charts or heat maps. \a shaded receives the shade of the color at the
+     * same position in \a colors and must be at least as large.
+     *
+     * The results are exactly the ones shade() gives for each color.
+     *
+     * \a contrast and \a chromaAdjust are used as in shade().
+     *
+     * \since 6.29
+     */
+    static void shade(QSpan<const QColor> colors, QSpan<QColor> shaded, ShadeRole role, qreal contrast, qreal chromaAdjust = 0.0);
+
     /*!
      * Adjust a QPalette by replacing the specified QPalette::ColorRole with
      * the requested background color for all states. Using this method is
@@ -419,12 +454,52 @@ public:
      */
     static qreal frameContrast(const KSharedConfigPtr &config = KSharedConfigPtr());
 
+    /*!
+     * Returns a counter that changes whenever the application's color scheme
+     * may have changed, e.g. because KColorSchemeManager activated another
+     * scheme or the application palette changed.
+     *
+     * Code caching colors obtained from KColorScheme can compare this value
+     * to decide whether the cached colors are still valid, instead of
+     * resolving the scheme again.
+     *
+     * \since 6.29
+     */
+    static quint64 generation();
+
+    /*!
+     * Applies the effects the color scheme defines for \a state to many
+     * foreground colors at once, e.g. to derive the disabled colors of a
+     * syntax highlighting theme. Each color is changed the same way the
+     * foreground brushes of a KColorScheme of that state are.
+     *
+     * \a colors the colors to change in place
+     *
+     * \a state the state whose effects to apply, QPalette::Active has none
+     *
+     * \a background the (active) background the colors are shown on
+     *
+     * \a config pointer to the config from which to read the effects. If
+     * null, the application's color scheme will be used.
+     *
+     * \sa KStatefulBrush
+     *
+     * \since 6.29
+     */
+    static void applyStateEffects(QSpan<QColor> colors,
+                                  QPalette::ColorGroup state,
+                                  const QColor &background,
+                                  const KSharedConfigPtr &config = KSharedConfigPtr());
+
     /*!
      * \since 5.92
      */
     bool operator==(const KColorScheme &other) const;
 
 private:
+    friend class KColorSchemeSnapshot;
+    explicit KColorScheme(const QExplicitlySharedDataPointer<KColorSchemePrivate> &d);
+
     QExplicitlySharedDataPointer<KColorSchemePrivate> d;
 };
 
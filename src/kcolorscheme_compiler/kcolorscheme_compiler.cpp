@@ -0,0 +1,156 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+// Turns a .colors file into a table of its contents, which KColorScheme finds
+// in the application's resources, see kcolorscheme_compile_schemes().
+
+#include "../kcolorschemetable_p.h"
+
+#include <KConfig>
+#include <KConfigGroup>
+
+#include <QColor>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QtEndian>
+
+#include <bit>
+#include <vector>
+
+static QString groupName(std::string_view name)
+{
+    return QString::fromLatin1(name.data(), name.size());
+}
+
+static const char *keyName(std::string_view key)
+{
+    // All keys are string literals
+    return key.data();
+}
+
+static void appendColorGroup(std::vector<quint64> &table, const KConfigGroup &group, bool exists)
+{
+    quint64 mask = exists ? SchemeTable::GroupExists : 0;
+    std::vector<quint64> values(SchemeTable::colorKeys.size(), 0);
+    for (std::size_t i = 0; i < SchemeTable::colorKeys.size(); ++i) {
+        // Malformed entries are left out, they get the default of the set like missing ones
+        const std::optional<QColor> color = exists ? SchemeTable::readColor(group, keyName(SchemeTable::colorKeys[i])) : std::nullopt;
+        if (!color) {
+            continue;
+        }
+        if (color->isValid()) {
+            mask |= quint64(1) << i;
+            values[i] = color->rgba64();
+        } else {
+            mask |= quint64(1) << (SchemeTable::InvalidShift + i);
+        }
+    }
+    table.push_back(mask);
+    table.insert(table.end(), values.begin(), values.end());
+}
+
+static void appendEffectGroup(std::vector<quint64> &table, const KConfigGroup &group)
+{
+    quint64 mask = group.exists() ? SchemeTable::GroupExists : 0;
+    std::vector<quint64> values(SchemeTable::effectKeys.size(), 0);
+    for (std::size_t i = 0; i < SchemeTable::effectKeys.size(); ++i) {
+        const auto [name, type] = SchemeTable::effectKeys[i];
+        const char *key = keyName(name);
+        if (!group.hasKey(key)) {
+            continue;
+        }
+        switch (type) {
+        case SchemeTable::EntryType::Bool:
+            values[i] = group.readEntry(key, false) ? 1 : 0;
+            break;
+        case SchemeTable::EntryType::Int:
+            values[i] = quint64(qint64(group.readEntry(key, 0)));
+            break;
+        case SchemeTable::EntryType::Double:
+            values[i] = std::bit_cast<quint64>(group.readEntry(key, 0.0));
+            break;
+        case SchemeTable::EntryType::Color: {
+            // Invalid colors are read as the default, just like a missing entry
+            const QColor color = group.readEntry(key, QColor());
+            if (!color.isValid()) {
+                continue;
+            }
+            values[i] = color.rgba64();
+            break;
+        }
+        }
+        mask |= quint64(1) << i;
+    }
+    table.push_back(mask);
+    table.insert(table.end(), values.begin(), values.end());
+}
+
+static std::vector<quint64> compile(const KConfig &config)
+{
+    std::vector<quint64> table{SchemeTable::Magic};
+    for (const auto name : SchemeTable::colorSetGroups) {
+        const KConfigGroup group(&config, groupName(name));
+        appendColorGroup(table, group, true);
+        const KConfigGroup inactiveGroup(&group, QStringLiteral("Inactive"));
+        appendColorGroup(table, inactiveGroup, inactiveGroup.exists());
+    }
+    for (const auto name : SchemeTable::effectGroups) {
+        appendEffectGroup(table, KConfigGroup(&config, groupName(name)));
+    }
+
+    const KConfigGroup group(&config, QStringLiteral("KDE"));
+    const bool hasContrast = group.hasKey("contrast");
+    table.push_back(hasContrast ? 1 : 0);
+    table.push_back(hasContrast ? quint64(qint64(group.readEntry("contrast", 7))) : 0);
+
+    Q_ASSERT(table.size() == SchemeTable::size);
+    return table;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("kcolorscheme_compiler"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Compiles a color scheme into a table KColorScheme reads from the application's resources"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("file.colors"), QStringLiteral("Color scheme to compile"));
+    parser.addPositionalArgument(QStringLiteral("output"), QStringLiteral("File to write the table to"));
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2) {
+        parser.showHelp(1);
+    }
+    const QString input = args.at(0);
+    const QString output = args.at(1);
+
+    if (!QFileInfo::exists(input)) {
+        QTextStream(stderr) << "Color scheme " << input << " does not exist\n";
+        return 1;
+    }
+    std::vector<quint64> table = compile(KConfig(input, KConfig::SimpleConfig));
+    // The compiler may run on a host of another byte order than the application
+    for (quint64 &value : table) {
+        value = qToLittleEndian(value);
+    }
+
+    QFile file(output);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QTextStream(stderr) << "Could not write " << output << ": " << file.errorString() << "\n";
+        return 1;
+    }
+    if (file.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(quint64)) != qint64(table.size() * sizeof(quint64))) {
+        QTextStream(stderr) << "Could not write " << output << ": " << file.errorString() << "\n";
+        return 1;
+    }
+    return 0;
+}
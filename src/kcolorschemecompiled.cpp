@@ -0,0 +1,173 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "kcolorschemecompiled_p.h"
+
+#include "kcolorscheme_debug.h"
+#include "kcolorschemetable_p.h"
+
+#include <KConfig>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QResource>
+#include <QStandardPaths>
+#include <QTimeZone>
+#include <QtEndian>
+
+#include <algorithm>
+
+namespace
+{
+constexpr QDataStream::Version s_streamVersion = QDataStream::Qt_6_5;
+
+// Identifies the state of a file a scheme was read from
+struct SourceStamp {
+    QString path;
+    qint64 modified = 0;
+    qint64 size = 0;
+};
+
+SourceStamp stamp(const QString &path)
+{
+    const QFileInfo info(path);
+    return {path, info.exists() ? info.lastModified(QTimeZone::UTC).toMSecsSinceEpoch() : -1, info.size()};
+}
+
+/*
+ * The files the data of config comes from, nothing if they can't be stamped:
+ * configs with unsaved changes or extra sources, or not backed by a single file on disk.
+ */
+std::optional<QStringList> schemeSources(const KSharedConfigPtr &config)
+{
+    if (!config || config->isDirty() || !config->additionalConfigSources().isEmpty()) {
+        return std::nullopt;
+    }
+    const QString path = config->name();
+    if (path.startsWith(QLatin1Char(':')) || !QDir::isAbsolutePath(path) || !QFileInfo::exists(path)) {
+        return std::nullopt;
+    }
+
+    QStringList sources{path};
+    if (config->openFlags() & KConfig::IncludeGlobals) {
+        // Colors the scheme file lacks fall back to the global settings
+        sources << QStandardPaths::locateAll(QStandardPaths::GenericConfigLocation, QStringLiteral("kdeglobals"));
+    }
+    return sources;
+}
+
+// Whether a source may still be changing within the resolution of its timestamp
+bool changedRecently(const QStringList &sources)
+{
+    const QDateTime recent = QDateTime::currentDateTimeUtc().addSecs(-2);
+    return std::any_of(sources.cbegin(), sources.cend(), [&recent](const QString &source) {
+        return QFileInfo(source).lastModified(QTimeZone::UTC) > recent;
+    });
+}
+}
+
+QString CompiledScheme::fileName(const KSharedConfigPtr &config)
+{
+    QByteArray key = config->name().toUtf8();
+    if (config->openFlags() & KConfig::IncludeGlobals) {
+        key += "\ninclude-globals";
+    }
+    return QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex());
+}
+
+QByteArray CompiledScheme::sourceStamps(const KSharedConfigPtr &config, StampPurpose purpose)
+{
+    const auto sources = schemeSources(config);
+    if (!sources || (purpose == ForWriting && changedRecently(*sources))) {
+        return {};
+    }
+
+    QByteArray stamps;
+    QDataStream stream(&stamps, QIODevice::WriteOnly);
+    stream.setVersion(s_streamVersion);
+    for (const QString &path : *sources) {
+        const SourceStamp source = stamp(path);
+        stream << source.path << source.modified << source.size;
+    }
+    return stamps;
+}
+
+std::optional<SchemeData> CompiledScheme::fromTable(QSpan<const quint64> table)
+{
+    if (table.size() != qsizetype(SchemeTable::size) || table[0] != SchemeTable::Magic) {
+        return std::nullopt;
+    }
+
+    const auto readEntries = [table](std::size_t offset) {
+        ColorGroupEntries entries;
+        const quint64 mask = table[offset];
+        for (std::size_t i = 0; i < SchemeTable::colorKeys.size(); ++i) {
+            std::optional<QColor> color;
+            if (mask & (quint64(1) << i)) {
+                color = QColor(QRgba64::fromRgba64(table[offset + 1 + i]));
+            } else if (mask & (quint64(1) << (SchemeTable::InvalidShift + i))) {
+                color = QColor();
+            }
+            if (i < entries.colors.size()) {
+                entries.colors[i] = color;
+            } else {
+                entries.decoration[i - entries.colors.size()] = color;
+            }
+        }
+        return entries;
+    };
+
+    SchemeData data;
+    for (int set = 0; set < KColorScheme::NColorSets; ++set) {
+        data.groups[set] = readEntries(SchemeTable::colorGroupOffset(set, false));
+        const std::size_t inactiveOffset = SchemeTable::colorGroupOffset(set, true);
+        if (table[inactiveOffset] & SchemeTable::GroupExists) {
+            data.inactiveGroups[set] = readEntries(inactiveOffset);
+        }
+    }
+
+    data.inactiveEffects = std::make_shared<const StateEffects>(QPalette::Inactive, table.subspan(SchemeTable::effectGroupOffset(0), SchemeTable::effectGroupSize));
+    data.disabledEffects = std::make_shared<const StateEffects>(QPalette::Disabled, table.subspan(SchemeTable::effectGroupOffset(1), SchemeTable::effectGroupSize));
+
+    // Keep in sync with KColorScheme::contrastF()
+    const bool hasContrast = table[SchemeTable::contrastOffset] & 1;
+    data.contrast = 0.1 * (hasContrast ? int(qint64(table[SchemeTable::contrastOffset + 1])) : 7);
+    return data;
+}
+
+std::optional<SchemeData> CompiledScheme::builtIn(const KSharedConfigPtr &config)
+{
+    if (!config || config->isDirty() || (config->openFlags() & KConfig::IncludeGlobals) || !config->additionalConfigSources().isEmpty()) {
+        return std::nullopt;
+    }
+
+    const QString name = QString::fromLatin1(QCryptographicHash::hash(config->name().toUtf8(), QCryptographicHash::Sha1).toHex());
+    const QResource resource(QLatin1String(SchemeTable::ResourceDirectory) + name);
+    if (!resource.isValid()) {
+        return std::nullopt;
+    }
+
+    // Resources aren't necessarily aligned for quint64
+    const QByteArray data = resource.uncompressedData();
+    std::array<quint64, SchemeTable::size> table;
+    if (data.size() != qsizetype(sizeof(table))) {
+        qCWarning(KCOLORSCHEME) << "Ignoring compiled color scheme" << config->name() << "generated by another version of kcolorscheme_compiler";
+        return std::nullopt;
+    }
+    for (std::size_t i = 0; i < table.size(); ++i) {
+        table[i] = qFromLittleEndian<quint64>(data.constData() + i * sizeof(quint64));
+    }
+
+    auto scheme = fromTable(table);
+    if (!scheme) {
+        qCWarning(KCOLORSCHEME) << "Ignoring compiled color scheme" << config->name() << "generated by another version of kcolorscheme_compiler";
+    }
+    return scheme;
+}
@@ -0,0 +1,53 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KCOLORSCHEMECOMPILED_P_H
+#define KCOLORSCHEMECOMPILED_P_H
+
+#include "kcolorschemehelpers_p.h"
+
+#include <QByteArray>
+
+#include <optional>
+
+/*
+ * Compiled color schemes: the SchemeData of a .colors file, generated at build
+ * time by kcolorscheme_compiler, and the stamps telling whether the files a
+ * scheme was read from changed since.
+ */
+namespace CompiledScheme
+{
+// Name identifying config among cached files, without a suffix
+QString fileName(const KSharedConfigPtr &config);
+
+enum StampPurpose {
+    ForReading,
+    // Sources that may still be changing give no stamps
+    ForWriting,
+};
+
+/*
+ * Opaque stamps of the files config's data comes from, equal as long as none
+ * of them changed. Empty if config isn't backed by plain, unmodified files.
+ */
+QByteArray sourceStamps(const KSharedConfigPtr &config, StampPurpose purpose);
+
+/*
+ * Decodes a table generated by kcolorscheme_compiler, see kcolorschemetable_p.h.
+ * Returns nothing if it was generated for another layout.
+ */
+std::optional<SchemeData> fromTable(QSpan<const quint64> table);
+
+/*
+ * The scheme data of config from the table kcolorscheme_compile_schemes() built
+ * into the application for its file, if there is one. A table only holds the
+ * file, configs reading anything else or with unsaved changes don't use it.
+ */
+std::optional<SchemeData> builtIn(const KSharedConfigPtr &config);
+}
+
+#endif
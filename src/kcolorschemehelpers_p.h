@@ -7,46 +7,101 @@
 #ifndef KCOLORSCHEME_P_H
 #define KCOLORSCHEME_P_H
 
+#include "kcolorscheme.h"
+
 #include <KSharedConfig>
 
-#include <QCoreApplication>
 #include <QPalette>
-#include <QVariant>
-
-#include "kcolorschememanager_p.h"
+#include <QSpan>
 
 #include <array>
+#include <memory>
+#include <optional>
 
-static KSharedConfigPtr defaultConfig()
-{
-    // cache the value we'll return, since usually it's going to be the same value
-    static thread_local KSharedConfigPtr config;
-    // Read from the application's color scheme file (as set by KColorSchemeManager).
-    // If unset, this is equivalent to openConfig() and the system scheme is used.
-    const auto colorSchemePath = qApp->property("KDE_COLOR_SCHEME_PATH").toString();
-    // If no color scheme is set and high-contrast is active then use the system colors
-    if (colorSchemePath.isEmpty() && KColorSchemeManagerPrivate::contrastPreference() == KColorSchemeManagerPrivate::HighContrast) {
-        return {};
-    }
+class KConfigGroup;
 
-    if (!config || config->name() != colorSchemePath) {
-        config = KSharedConfig::openConfig(colorSchemePath);
-    }
-    return config;
-}
+/*
+ * Generation of the application's color scheme state. It is bumped whenever
+ * the scheme or its backing config may have changed; anything cached from a
+ * KSharedConfig must be dropped once the generation it was built for is gone.
+ */
+quint64 colorSchemeGeneration();
+void invalidateColorSchemeCaches();
+
+/*
+ * Re-reads which scheme the application uses (see KColorSchemeManager), bumps
+ * the generation and publishes the resolved scheme to all threads. GUI thread only.
+ */
+void updateDefaultColorScheme();
+
+/*
+ * The config of the application's scheme, null if the system palette is to be
+ * used instead. Only looks at the published scheme when the generation changed.
+ */
+KSharedConfigPtr defaultConfig();
+
+/*
+ * Makes the scheme at path the application's scheme, see KColorSchemeManager.
+ * The scheme is resolved completely before it is published, then all threads
+ * and the application palette switch over to it at once.
+ */
+void activateDefaultColorScheme(const QString &path);
+
+// A scheme resolved for activation, an empty path resets to the system scheme
+class PreparedColorScheme;
+
+// Resolves the scheme at path for activation, may be called from any thread
+std::shared_ptr<const PreparedColorScheme> prepareDefaultColorScheme(const QString &path);
+
+// Activates a prepared scheme like activateDefaultColorScheme(), on the GUI thread only
+void activateDefaultColorScheme(const std::shared_ptr<const PreparedColorScheme> &prepared);
 
 class StateEffects
 {
 public:
+    // No effects at all, like for the active state
+    StateEffects()
+        : _color(0, 0, 0, 0)
+    {
+    }
     explicit StateEffects(QPalette::ColorGroup state, const KSharedConfigPtr &);
+    // Reads the effects from an already opened ColorEffects:* group
+    explicit StateEffects(QPalette::ColorGroup state, const KConfigGroup &group);
+    // Reads the effects from the ColorEffects:* part of a table generated by kcolorscheme_compiler
+    explicit StateEffects(QPalette::ColorGroup state, QSpan<const quint64> table);
     ~StateEffects()
     {
     }
 
+    // The ColorEffects:* group holding the effects of the given state, empty if it has none
+    static QString groupName(QPalette::ColorGroup state);
+
+    /*
+     * The effects of the given state, shared by everyone using the same config
+     * until the scheme generation changes. Never returns null.
+     */
+    static std::shared_ptr<const StateEffects> forConfig(QPalette::ColorGroup state, const KSharedConfigPtr &config);
+
     QBrush brush(const QBrush &background) const;
     QBrush brush(const QBrush &foreground, const QBrush &background) const;
+    QColor color(const QColor &background) const;
+    QColor color(const QColor &foreground, const QColor &background) const;
+
+    // Like color(), for many colors at once
+    void apply(QSpan<QColor> backgrounds) const;
+    void apply(QSpan<QColor> foregrounds, const QColor &background) const;
+
+    // Whether inactive selections use the (tinted) Window colors, only meaningful for the inactive state
+    bool changesSelectionColor() const
+    {
+        return _changeSelectionColor;
+    }
 
 private:
+    // read(key, defaultValue) returns the value of the entry key of the ColorEffects:* group
+    template<typename Reader>
+    void readEffects(QPalette::ColorGroup state, const Reader &read);
+
     enum EffectTypes {
         Intensity,
         Color,
@@ -77,9 +132,25 @@ private:
         NContrastEffects,
     };
 
-    int _effects[NEffectTypes];
-    double _amount[NEffectTypes];
+    int _effects[NEffectTypes] = {};
+    double _amount[NEffectTypes] = {};
     QColor _color;
+    bool _changeSelectionColor = true;
+};
+
+// The entries of one Colors:* group, unset where the config has none
+struct ColorGroupEntries {
+    std::array<std::optional<QColor>, 10> colors;
+    std::array<std::optional<QColor>, 2> decoration;
+};
+
+// Everything a color scheme is resolved from, read from the config in a single pass
+struct SchemeData {
+    std::array<ColorGroupEntries, KColorScheme::NColorSets> groups;
+    std::array<std::optional<ColorGroupEntries>, KColorScheme::NColorSets> inactiveGroups;
+    std::shared_ptr<const StateEffects> inactiveEffects;
+    std::shared_ptr<const StateEffects> disabledEffects;
+    qreal contrast = 0.7;
 };
 
 #endif
@@ -9,6 +9,7 @@
 #include "kcolorschememanager_p.h"
 
 #include "kcolorscheme.h"
+#include "kcolorschemehelpers_p.h"
 #include "kcolorschememodel.h"
 
 #include <KConfigGroup>
@@ -20,10 +21,10 @@
 #include <QFileInfo>
 #include <QGuiApplication>
 #include <QIcon>
-#include <QPainter>
 #include <QPointer>
 #include <QStandardPaths>
 #include <QStyleHints>
+#include <QThreadPool>
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 10, 0)
 #include <QAccessibilityHints>
@@ -59,16 +60,91 @@ static bool isKdePlatformTheme()
     return false;
 }
 
+static void cancelActivation(const KColorSchemeManagerPrivate::Activation &activation)
+{
+    activation.promise->future().cancel();
+    activation.promise->finish();
+}
+
 void KColorSchemeManagerPrivate::activateSchemeInternal(const QString &colorSchemePath)
 {
-    // hint for plasma-integration to synchronize the color scheme with the window manager/compositor
-    // The property needs to be set before the palette change because is is checked upon the
-    // ApplicationPaletteChange event.
-    qApp->setProperty("KDE_COLOR_SCHEME_PATH", colorSchemePath);
-    if (colorSchemePath.isEmpty()) {
-        qApp->setPalette(QPalette());
+    // Supersedes all asynchronous requests so far
+    m_syncActivationSerial = ++m_activationSerial;
+    if (m_queuedActivation) {
+        cancelActivation(*m_queuedActivation);
+        m_queuedActivation.reset();
+    }
+
+    // Sets KDE_COLOR_SCHEME_PATH as a hint for plasma-integration to synchronize the
+    // color scheme with the window manager/compositor, then the palette
+    activateDefaultColorScheme(colorSchemePath);
+}
+
+QFuture<void> KColorSchemeManagerPrivate::activateSchemeAsync(KColorSchemeManager *q, const QString &path, const QString &id)
+{
+    Activation activation{path, id, ++m_activationSerial, std::make_shared<QPromise<void>>()};
+    activation.promise->start();
+    QFuture<void> future = activation.promise->future();
+
+    if (m_resolvingActivation) {
+        // Only the latest request waits for the one being resolved, which then gets dropped
+        if (m_queuedActivation) {
+            cancelActivation(*m_queuedActivation);
+        }
+        m_queuedActivation = std::move(activation);
     } else {
-        qApp->setPalette(KColorScheme::createApplicationPalette(KSharedConfig::openConfig(colorSchemePath)));
+        startActivation(q, activation);
+    }
+    return future;
+}
+
+void KColorSchemeManagerPrivate::startActivation(KColorSchemeManager *q, const Activation &activation)
+{
+    m_resolvingActivation = true;
+    if (!m_activationTarget) {
+        m_activationTarget = std::make_shared<ActivationTarget>();
+        m_activationTarget->manager = q;
+        m_activationTarget->d = this;
+    }
+    QThreadPool::globalInstance()->start([target = m_activationTarget, activation] {
+        // Nothing to resolve for a request canceled meanwhile
+        const auto prepared = activation.promise->isCanceled() ? nullptr : prepareDefaultColorScheme(activation.path);
+        QMutexLocker locker(&target->mutex);
+        if (!target->manager) {
+            cancelActivation(activation);
+            return;
+        }
+        // Dropped along with the request if the manager is destroyed before it is delivered
+        QMetaObject::invokeMethod(
+            target->manager,
+            [q = target->manager, d = target->d, activation, prepared] {
+                d->finishActivation(q, activation, prepared);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void KColorSchemeManagerPrivate::finishActivation(KColorSchemeManager *q, const Activation &activation, const std::shared_ptr<const PreparedColorScheme> &prepared)
+{
+    m_resolvingActivation = false;
+
+    // Applied even if another request is queued already, so that a steady stream
+    // of requests still shows the schemes as they are resolved
+    if (activation.serial > m_syncActivationSerial && !activation.promise->isCanceled()) {
+        m_activatedScheme = activation.id;
+        if (m_autosaveChanges) {
+            q->saveSchemeIdToConfigFile(activation.id);
+        }
+        activateDefaultColorScheme(prepared);
+        activation.promise->finish();
+    } else {
+        cancelActivation(activation);
+    }
+
+    if (m_queuedActivation) {
+        const Activation next = std::move(*m_queuedActivation);
+        m_queuedActivation.reset();
+        startActivation(q, next);
     }
 }
 
@@ -103,35 +179,26 @@ QString KColorSchemeManagerPrivate::automaticColorSchemePath() const
     }
 }
 
-QIcon KColorSchemeManagerPrivate::createPreview(const QString &path)
+KColorSchemePreviewEngine::Colors KColorSchemeManagerPrivate::previewColors(const QString &path)
 {
     KSharedConfigPtr schemeConfig = KSharedConfig::openConfig(path, KConfig::SimpleConfig);
-    QIcon result;
 
     KColorScheme activeWindow(QPalette::Active, KColorScheme::Window, schemeConfig);
     KColorScheme activeButton(QPalette::Active, KColorScheme::Button, schemeConfig);
     KColorScheme activeView(QPalette::Active, KColorScheme::View, schemeConfig);
     KColorScheme activeSelection(QPalette::Active, KColorScheme::Selection, schemeConfig);
 
-    auto pixmap = [&](int size) {
-        QPixmap pix(size, size);
-        pix.fill(Qt::black);
-        QPainter p;
-        p.begin(&pix);
-        const int itemSize = size / 2 - 1;
-        p.fillRect(1, 1, itemSize, itemSize, activeWindow.background());
-        p.fillRect(1 + itemSize, 1, itemSize, itemSize, activeButton.background());
-        p.fillRect(1, 1 + itemSize, itemSize, itemSize, activeView.background());
-        p.fillRect(1 + itemSize, 1 + itemSize, itemSize, itemSize, activeSelection.background());
-        p.end();
-        result.addPixmap(pix);
+    return {
+        activeWindow.background().color().rgba(),
+        activeButton.background().color().rgba(),
+        activeView.background().color().rgba(),
+        activeSelection.background().color().rgba(),
     };
-    // 16x16
-    pixmap(16);
-    // 24x24
-    pixmap(24);
+}
 
-    return result;
+QIcon KColorSchemeManagerPrivate::createPreview(const KColorSchemePreviewEngine::Colors &colors)
+{
+    return QIcon(new KColorSchemePreviewEngine(colors));
 }
 
 KColorSchemeManagerPrivate::KColorSchemeManagerPrivate()
@@ -157,6 +224,14 @@ KColorSchemeManager::KColorSchemeManager(QObject *parent)
 
 KColorSchemeManager::~KColorSchemeManager()
 {
+    if (d->m_queuedActivation) {
+        cancelActivation(*d->m_queuedActivation);
+    }
+    // Requests still being resolved get canceled from now on
+    if (d->m_activationTarget) {
+        QMutexLocker locker(&d->m_activationTarget->mutex);
+        d->m_activationTarget->manager = nullptr;
+    }
 }
 
 void KColorSchemeManager::init()
@@ -226,13 +301,7 @@ QModelIndex KColorSchemeManagerPrivate::indexForSchemeId(const QString &id) cons
     if (id.isEmpty()) {
         return model->index(defaultSchemeRow);
     }
-    for (int i = 1; i < model->rowCount(); ++i) {
-        QModelIndex index = model->index(i);
-        if (index.data(KColorSchemeModel::IdRole).toString() == id) {
-            return index;
-        }
-    }
-    return QModelIndex();
+    return model->indexForId(id);
 }
 
 void KColorSchemeManager::setAutosaveChanges(bool autosaveChanges)
@@ -251,13 +320,7 @@ QModelIndex KColorSchemeManager::indexForScheme(const QString &name) const
     if (name.isEmpty()) {
         return d->model->index(defaultSchemeRow);
     }
-    for (int i = 1; i < d->model->rowCount(); ++i) {
-        QModelIndex index = d->model->index(i);
-        if (index.data(KColorSchemeModel::NameRole).toString() == name) {
-            return index;
-        }
-    }
-    return QModelIndex();
+    return d->model->indexForName(name);
 }
 
 void KColorSchemeManager::activateScheme(const QModelIndex &index)
@@ -279,6 +342,21 @@ void KColorSchemeManager::activateScheme(const QModelIndex &index)
     }
 }
 
+QFuture<void> KColorSchemeManager::activateSchemeAsync(const QModelIndex &index)
+{
+    const bool isDefaultEntry = index.data(KColorSchemeModel::PathRole).toString().isEmpty();
+
+    if (index.isValid() && index.model() == d->model.get() && !isDefaultEntry) {
+        return d->activateSchemeAsync(this, index.data(KColorSchemeModel::PathRole).toString(), index.data(KColorSchemeModel::IdRole).toString());
+    }
+    return d->activateSchemeAsync(this, d->automaticColorSchemePath(), QString());
+}
+
+QFuture<void> KColorSchemeManager::activateSchemeIdAsync(const QString &schemeId)
+{
+    return activateSchemeAsync(d->indexForSchemeId(schemeId));
+}
+
 void KColorSchemeManager::activateSchemeId(const QString &schemeId)
 {
     auto index = d->indexForSchemeId(schemeId);
@@ -10,6 +10,7 @@
 
 #include <kcolorscheme_export.h>
 
+#include <QFuture>
 #include <QObject>
 #include <memory>
 
@@ -157,6 +158,40 @@ public:
      */
     static KColorSchemeManager *instance();
 
+    /*!
+     * \brief Activates the KColorScheme identified by the provided \a index
+     * without blocking the GUI thread.
+     *
+     * Like activateScheme(), but the scheme is read and resolved on a worker
+     * thread. Once it is resolved, the application palette is replaced in one
+     * step on the GUI thread, and activeSchemeId() changes only then.
+     *
+     * Requests made while a scheme is being resolved are coalesced: that scheme
+     * is still activated once it is resolved, and of the requests made meanwhile
+     * only the latest one is activated afterwards, e.g. when scrolling through a
+     * list of schemes with live preview. A synchronous activation supersedes the
+     * asynchronous requests before it.
+     *
+     * Returns a future that finishes once the scheme was activated, or is
+     * canceled if the request was superseded.
+     *
+     * \sa activateScheme()
+     * \since 6.29
+     */
+    QFuture<void> activateSchemeAsync(const QModelIndex &index);
+
+    /*!
+     * \brief Activates the KColorScheme identified by the provided \a schemeId
+     * without blocking the GUI thread.
+     *
+     * Passing an empty id activates the system scheme. See activateSchemeAsync()
+     * for details.
+     *
+     * \sa activateSchemeId()
+     * \since 6.29
+     */
+    QFuture<void> activateSchemeIdAsync(const QString &schemeId);
+
 public Q_SLOTS:
     /*!
      * \brief Activates the KColorScheme identified by the provided \param index.
@@ -9,10 +9,17 @@
 #define KCOLORSCHEMEMANAGER_P_H
 
 #include <memory>
+#include <optional>
+
+#include <QFuture>
+#include <QMutex>
+#include <QPromise>
 
 #include "kcolorschememodel.h"
+#include "kcolorschemepreview_p.h"
 
 class KColorSchemeManager;
+class PreparedColorScheme;
 
 class KColorSchemeManagerPrivate
 {
@@ -23,8 +30,34 @@ public:
     bool m_autosaveChanges = true;
     QString m_activatedScheme;
 
-    static QIcon createPreview(const QString &path);
+    // Thread-safe, the colors createPreview() makes an icon of
+    static KColorSchemePreviewEngine::Colors previewColors(const QString &path);
+    static QIcon createPreview(const KColorSchemePreviewEngine::Colors &colors);
     void activateSchemeInternal(const QString &colorSchemePath);
+
+    // A request of KColorSchemeManager::activateSchemeAsync()
+    struct Activation {
+        QString path;
+        // Id to remember as the activated scheme, empty for the default one
+        QString id;
+        quint64 serial;
+        std::shared_ptr<QPromise<void>> promise;
+    };
+    QFuture<void> activateSchemeAsync(KColorSchemeManager *q, const QString &path, const QString &id);
+    void startActivation(KColorSchemeManager *q, const Activation &activation);
+    void finishActivation(KColorSchemeManager *q, const Activation &activation, const std::shared_ptr<const PreparedColorScheme> &prepared);
+    // Every activation bumps this, asynchronous ones only apply if no synchronous one came after them
+    quint64 m_activationSerial = 0;
+    quint64 m_syncActivationSerial = 0;
+    bool m_resolvingActivation = false;
+    std::optional<Activation> m_queuedActivation;
+    // Lets activations resolved on another thread reach the manager, unless it got destroyed meanwhile
+    struct ActivationTarget {
+        QMutex mutex;
+        KColorSchemeManager *manager = nullptr;
+        KColorSchemeManagerPrivate *d = nullptr;
+    };
+    std::shared_ptr<ActivationTarget> m_activationTarget;
     QString automaticColorSchemeId() const;
     QString automaticColorSchemePath() const;
     QModelIndex indexForSchemeId(const QString &id) const;
@@ -8,38 +8,74 @@
 #include "kcolorschememodel.h"
 
 #include "kcolorschememanager_p.h"
+#include "kcolorschemepreview_p.h"
+#include "kcolorschemescanner_p.h"
 
-#include <KConfigGroup>
 #include <KLocalizedString>
-#include <KSharedConfig>
 #include <kcolorscheme.h>
 
 #include <QDir>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHash>
 #include <QIcon>
-#include <QPainter>
+#include <QMutex>
 #include <QStandardPaths>
+#include <QThreadPool>
+#include <QTimer>
 
 #include <map>
+#include <memory>
+#include <optional>
 
 struct KColorSchemeModelData {
     QString id; // e.g. BreezeDark
     QString name; // e.g. "Breeze Dark" or "Breeze-Dunkel"
     QString path;
+    // Rendered on demand, see KColorSchemePreviewEngine
     QIcon preview;
+    qint64 modified = 0;
+    bool previewPending = false;
+    // The preview as stored in the cache directory, possibly of an older version of the file
+    std::optional<PreviewCache::Entry> storedPreview;
+};
+
+// Lets preview jobs deliver to a model, unless it got destroyed meanwhile
+struct KColorSchemeModelPreviewTarget {
+    QMutex mutex;
+    KColorSchemeModel *model;
+    KColorSchemeModelPrivate *d;
 };
 
 struct KColorSchemeModelPrivate {
+    QIcon preview(int row);
+    void requestPreview(int row);
+    void setPreview(KColorSchemeModel *q, const QString &path, qint64 modified, const PreviewCache::Entry &stored);
+    void restorePreviews();
+    void storePreviews();
+    void updateIndexes();
+
     mutable QList<KColorSchemeModelData> m_data;
+    // Rows by id and name, rebuilt on the next lookup once rows changed
+    QHash<QString, int> m_rowsById;
+    QHash<QString, int> m_rowsByName;
+    bool m_indexesValid = false;
+    std::shared_ptr<KColorSchemeModelPreviewTarget> m_previewTarget;
+    // Reserves the space of the preview in views while it is rendered
+    QIcon m_placeholder;
+    // Whether the previews in the cache directory were read, which happens when the first one is asked for
+    bool m_previewsRestored = false;
+    // Previews rendered in a row are stored at once
+    QTimer m_storeTimer;
+    QFileSystemWatcher m_watcher;
+    // An ancestor of the user's color-schemes directory while that doesn't exist
+    QString m_watchedAncestor;
+    // Installing several schemes at once changes a directory many times in a row
+    QTimer m_updateTimer;
 };
 
-KColorSchemeModel::KColorSchemeModel(QObject *parent)
-    : QAbstractListModel(parent)
-    , d(new KColorSchemeModelPrivate)
+static QStringList schemeDirectories()
 {
-    beginResetModel();
-    d->m_data.clear();
-
 #ifndef Q_OS_ANDROID
     // Fill the model with all *.colors files from the XDG_DATA_DIRS, sorted by "Name".
     // If two color schemes, in user's $HOME and e.g. /usr, respectively, have the same
@@ -51,30 +87,289 @@ KColorSchemeModel::KColorSchemeModel(QObject *parent)
 
     // allow to bundle color schemes with applications
     dirPaths << QStringLiteral(":/org.kde.kcolorscheme/color-schemes");
+    return dirPaths;
+}
+
+// The file name, which the rows after the default one are sorted by
+static QString schemeFileName(const KColorSchemeModelData &data)
+{
+    return data.id + QLatin1String(".colors");
+}
 
-    std::map<QString, QString> map;
-    for (const QString &dirPath : dirPaths) {
-        const QDir dir(dirPath);
-        const QStringList fileNames = dir.entryList({QStringLiteral("*.colors")});
-        for (const auto &file : fileNames) {
-            map.insert({file, dir.filePath(file)});
+static QList<KColorSchemeModelData> readSchemes(const QStringList &dirPaths)
+{
+    // Directories that didn't change since the last scan come from an index in the cache
+    std::map<QString, KColorSchemeModelData> map;
+    for (const auto &dir : SchemeScanner::scan(dirPaths)) {
+        for (const auto &file : dir.files) {
+            if (map.contains(file.fileName)) {
+                continue;
+            }
+            const QString schemeFilePath = QDir(dir.path).filePath(file.fileName);
+            const QString name = file.name.isNull() ? QFileInfo(schemeFilePath).baseName() : file.name;
+            const QString id = file.fileName.chopped(QLatin1String(".colors").size()); // Remove .colors ending
+            map.insert({file.fileName, {id, name, schemeFilePath, QIcon(), file.modified}});
         }
     }
 
-    for (const auto &[key, schemeFilePath] : map) {
-        KSharedConfigPtr config = KSharedConfig::openConfig(schemeFilePath, KConfig::SimpleConfig);
-        KConfigGroup group(config, QStringLiteral("General"));
-        const QString name = group.readEntry("Name", QFileInfo(schemeFilePath).baseName());
-        const QString id = key.chopped(QLatin1String(".colors").size()); // Remove .colors ending
-        const KColorSchemeModelData data = {id, name, schemeFilePath, QIcon()};
-        d->m_data.append(data);
+    QList<KColorSchemeModelData> schemes;
+    schemes.reserve(map.size());
+    for (const auto &[key, data] : map) {
+        schemes.append(data);
     }
+    return schemes;
+}
 
+KColorSchemeModel::KColorSchemeModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , d(new KColorSchemeModelPrivate)
+{
+    beginResetModel();
+    d->m_data = readSchemes(schemeDirectories());
     d->m_data.insert(0, {QString(), i18n("Default"), QString(), QIcon::fromTheme(QStringLiteral("edit-undo"))});
     endResetModel();
+
+    d->m_placeholder = QIcon(new KColorSchemePreviewEngine);
+    d->m_previewTarget = std::make_shared<KColorSchemeModelPreviewTarget>();
+    d->m_previewTarget->model = this;
+    d->m_previewTarget->d = d.get();
+
+    d->m_storeTimer.setSingleShot(true);
+    d->m_storeTimer.setInterval(1000);
+    connect(&d->m_storeTimer, &QTimer::timeout, this, [this] {
+        d->storePreviews();
+    });
+
+    d->m_updateTimer.setSingleShot(true);
+    d->m_updateTimer.setInterval(250);
+    connect(&d->m_updateTimer, &QTimer::timeout, this, &KColorSchemeModel::updateSchemes);
+    connect(&d->m_watcher, &QFileSystemWatcher::directoryChanged, this, [this](const QString &path) {
+        if (path != d->m_watchedAncestor) {
+            d->m_updateTimer.start();
+            return;
+        }
+        // Of the changes below an ancestor only the user's directory appearing matters
+        watchDirectories();
+        if (d->m_watchedAncestor.isEmpty()) {
+            d->m_updateTimer.start();
+        }
+    });
+    watchDirectories();
 }
 
-KColorSchemeModel::~KColorSchemeModel() = default;
+void KColorSchemeModel::watchDirectories()
+{
+    QStringList dirs;
+    for (const QString &dir : schemeDirectories()) {
+        // Bundled schemes never change
+        if (!dir.startsWith(QLatin1Char(':')) && !dir.startsWith(QLatin1String("assets:"))) {
+            dirs.append(dir);
+        }
+    }
+#ifndef Q_OS_ANDROID
+    // The user's directory only gets created once the first scheme is installed there,
+    // until then its closest existing ancestor is watched for it to appear
+    d->m_watchedAncestor.clear();
+    QString userDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QStringLiteral("/color-schemes");
+    while (!QFileInfo::exists(userDir)) {
+        const QString parent = QFileInfo(userDir).absolutePath();
+        if (parent == userDir) {
+            break;
+        }
+        userDir = parent;
+        d->m_watchedAncestor = parent;
+    }
+    if (!d->m_watchedAncestor.isEmpty() && QFileInfo::exists(d->m_watchedAncestor)) {
+        dirs.append(d->m_watchedAncestor);
+    }
+#endif
+
+    const QStringList watched = d->m_watcher.directories();
+    if (watched != dirs) {
+        if (!watched.isEmpty()) {
+            d->m_watcher.removePaths(watched);
+        }
+        if (!dirs.isEmpty()) {
+            d->m_watcher.addPaths(dirs);
+        }
+    }
+}
+
+void KColorSchemeModel::updateSchemes()
+{
+    watchDirectories();
+    const QList<KColorSchemeModelData> schemes = readSchemes(schemeDirectories());
+
+    // Both lists are sorted by file name, walk them side by side. Rows that
+    // didn't change are left alone, including their previews.
+    int row = 1;
+    qsizetype next = 0;
+    while (row < d->m_data.size() || next < schemes.size()) {
+        if (next == schemes.size() || (row < d->m_data.size() && schemeFileName(d->m_data[row]) < schemeFileName(schemes[next]))) {
+            beginRemoveRows(QModelIndex(), row, row);
+            d->m_data.removeAt(row);
+            d->m_indexesValid = false;
+            endRemoveRows();
+            continue;
+        }
+
+        const KColorSchemeModelData &scheme = schemes[next++];
+        if (row == d->m_data.size() || schemeFileName(scheme) < schemeFileName(d->m_data[row])) {
+            beginInsertRows(QModelIndex(), row, row);
+            d->m_data.insert(row, scheme);
+            d->m_indexesValid = false;
+            endInsertRows();
+        } else {
+            auto &data = d->m_data[row];
+            if (data.path != scheme.path || data.modified != scheme.modified || data.name != scheme.name) {
+                // A file that was touched but still has the same contents keeps its preview
+                std::optional<PreviewCache::Entry> storedPreview;
+                if (data.path == scheme.path) {
+                    storedPreview = std::move(data.storedPreview);
+                }
+                data = scheme;
+                data.storedPreview = std::move(storedPreview);
+                d->m_indexesValid = false;
+                Q_EMIT dataChanged(index(row), index(row));
+            }
+        }
+        ++row;
+    }
+}
+
+KColorSchemeModel::~KColorSchemeModel()
+{
+    if (d->m_storeTimer.isActive()) {
+        d->storePreviews();
+    }
+    // Jobs still running discard their previews from now on
+    QMutexLocker locker(&d->m_previewTarget->mutex);
+    d->m_previewTarget->model = nullptr;
+}
+
+QIcon KColorSchemeModelPrivate::preview(int row)
+{
+    auto &item = m_data[row];
+    if (!item.preview.isNull()) {
+        return item.preview;
+    }
+    if (!m_previewsRestored) {
+        restorePreviews();
+    }
+    if (item.storedPreview && item.storedPreview->modified == item.modified) {
+        item.preview = QIcon(new KColorSchemePreviewEngine(item.storedPreview->colors));
+        return item.preview;
+    }
+
+    if (!item.previewPending) {
+        requestPreview(row);
+    }
+    return m_placeholder;
+}
+
+void KColorSchemeModelPrivate::requestPreview(int row)
+{
+    auto &item = m_data[row];
+    item.previewPending = true;
+    // A file that was touched but still has the same contents doesn't need to be read again
+    QThreadPool::globalInstance()->start([target = m_previewTarget, path = item.path, modified = item.modified, stored = item.storedPreview] {
+        PreviewCache::Entry entry{modified, PreviewCache::contentHash(path)};
+        if (stored && !entry.contentHash.isEmpty() && stored->contentHash == entry.contentHash) {
+            entry.colors = stored->colors;
+        } else {
+            entry.colors = KColorSchemeManagerPrivate::previewColors(path);
+        }
+        QMutexLocker locker(&target->mutex);
+        if (target->model) {
+            QMetaObject::invokeMethod(
+                target->model,
+                [model = target->model, d = target->d, path, modified, entry] {
+                    d->setPreview(model, path, modified, entry);
+                },
+                Qt::QueuedConnection);
+        }
+    });
+}
+
+void KColorSchemeModelPrivate::setPreview(KColorSchemeModel *q, const QString &path, qint64 modified, const PreviewCache::Entry &stored)
+{
+    for (int row = 0; row < m_data.size(); ++row) {
+        auto &item = m_data[row];
+        if (item.path != path) {
+            continue;
+        }
+        // A scheme that changed meanwhile gets rendered again when asked for
+        if (item.previewPending && item.modified == modified) {
+            item.preview = KColorSchemeManagerPrivate::createPreview(stored.colors);
+            item.previewPending = false;
+            // The default entry has no file of its own
+            if (!path.isEmpty() && !stored.contentHash.isEmpty()) {
+                item.storedPreview = stored;
+                m_storeTimer.start();
+            }
+            const QModelIndex changed = q->index(row);
+            Q_EMIT q->dataChanged(changed, changed, {KColorSchemeModel::IconRole});
+        }
+        return;
+    }
+}
+
+void KColorSchemeModelPrivate::updateIndexes()
+{
+    m_rowsById.clear();
+    m_rowsByName.clear();
+    m_rowsById.reserve(m_data.size());
+    m_rowsByName.reserve(m_data.size());
+    for (int row = 1; row < m_data.size(); ++row) {
+        m_rowsById.insert(m_data[row].id, row);
+        // Names may be shared, the first row with one wins
+        m_rowsByName.tryEmplace(m_data[row].name, row);
+    }
+    m_indexesValid = true;
+}
+
+QModelIndex KColorSchemeModel::indexForId(const QString &id) const
+{
+    if (!d->m_indexesValid) {
+        d->updateIndexes();
+    }
+    const int row = d->m_rowsById.value(id, -1);
+    return row < 0 ? QModelIndex() : index(row);
+}
+
+QModelIndex KColorSchemeModel::indexForName(const QString &name) const
+{
+    if (!d->m_indexesValid) {
+        d->updateIndexes();
+    }
+    const int row = d->m_rowsByName.value(name, -1);
+    return row < 0 ? QModelIndex() : index(row);
+}
+
+void KColorSchemeModelPrivate::restorePreviews()
+{
+    m_previewsRestored = true;
+    // Only the previews of listed schemes are kept, the rest is dropped with the file the next time it is stored
+    const QHash<QString, PreviewCache::Entry> stored = PreviewCache::load();
+    for (auto &item : m_data) {
+        if (const auto it = stored.constFind(item.path); it != stored.cend()) {
+            item.storedPreview = *it;
+        }
+    }
+}
+
+void KColorSchemeModelPrivate::storePreviews()
+{
+    m_storeTimer.stop();
+    // Schemes that are gone are dropped along the way
+    QHash<QString, PreviewCache::Entry> entries;
+    for (const auto &item : std::as_const(m_data)) {
+        if (item.storedPreview) {
+            entries.insert(item.path, *item.storedPreview);
+        }
+    }
+    PreviewCache::store(entries);
+}
 
 int KColorSchemeModel::rowCount(const QModelIndex &parent) const
 {
@@ -93,13 +388,8 @@ QVariant KColorSchemeModel::data(const QModelIndex &index, int role) const
     switch (role) {
     case NameRole:
         return d->m_data.at(index.row()).name;
-    case IconRole: {
-        auto &item = d->m_data[index.row()];
-        if (item.preview.isNull()) {
-            item.preview = KColorSchemeManagerPrivate::createPreview(item.path);
-        }
-        return item.preview;
-    }
+    case IconRole:
+        return d->preview(index.row());
     case PathRole:
         return d->m_data.at(index.row()).path;
     case IdRole:
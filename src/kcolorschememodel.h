@@ -32,7 +32,10 @@ class KColorSchemeModel : public QAbstractListModel
 public:
     /*!
      * \value NameRole
-     * \value IconRole
+     * \value IconRole A preview of the scheme. Previews are rendered in the
+     * background, until one is ready a blank placeholder is returned and
+     * dataChanged() is emitted for the row once it is. A preview only keeps
+     * the few colors it shows and is painted whenever it is asked for a pixmap.
      * \value PathRole
      * \value IdRole
      */
@@ -49,6 +52,15 @@ public:
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 
 private:
+    KCOLORSCHEME_NO_EXPORT void watchDirectories();
+    KCOLORSCHEME_NO_EXPORT void updateSchemes();
+    // The scheme with the given id or name, not the default entry
+    KCOLORSCHEME_NO_EXPORT QModelIndex indexForId(const QString &id) const;
+    KCOLORSCHEME_NO_EXPORT QModelIndex indexForName(const QString &name) const;
+
+    friend class KColorSchemeManager;
+    friend class KColorSchemeManagerPrivate;
+
     std::unique_ptr<KColorSchemeModelPrivate> d;
 };
 
@@ -0,0 +1,153 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "kcolorschemepreview_p.h"
+
+#include "kcolorscheme_debug.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPainter>
+#include <QPixmap>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+KColorSchemePreviewEngine::KColorSchemePreviewEngine(const std::optional<Colors> &colors)
+    : m_colors(colors)
+{
+}
+
+void KColorSchemePreviewEngine::paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state)
+{
+    Q_UNUSED(mode)
+    Q_UNUSED(state)
+    if (!m_colors) {
+        return;
+    }
+
+    // A black frame around and between the squares, as thick as a device pixel
+    const int size = qMin(rect.width(), rect.height());
+    const QRectF square(rect.x() + (rect.width() - size) / 2, rect.y() + (rect.height() - size) / 2, size, size);
+    const qreal border = 1 / painter->device()->devicePixelRatio();
+    const qreal itemSize = size / 2.0 - border;
+
+    painter->fillRect(square, Qt::black);
+    painter->fillRect(QRectF(square.x() + border, square.y() + border, itemSize, itemSize), QColor::fromRgba((*m_colors)[0]));
+    painter->fillRect(QRectF(square.x() + border + itemSize, square.y() + border, itemSize, itemSize), QColor::fromRgba((*m_colors)[1]));
+    painter->fillRect(QRectF(square.x() + border, square.y() + border + itemSize, itemSize, itemSize), QColor::fromRgba((*m_colors)[2]));
+    painter->fillRect(QRectF(square.x() + border + itemSize, square.y() + border + itemSize, itemSize, itemSize), QColor::fromRgba((*m_colors)[3]));
+}
+
+QPixmap KColorSchemePreviewEngine::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state)
+{
+    return scaledPixmap(size, mode, state, 1.0);
+}
+
+QPixmap KColorSchemePreviewEngine::scaledPixmap(const QSize &size, QIcon::Mode mode, QIcon::State state, qreal scale)
+{
+    QPixmap pixmap(size * scale);
+    pixmap.setDevicePixelRatio(scale);
+    pixmap.fill(Qt::transparent);
+    QPainter painter(&pixmap);
+    paint(&painter, QRect(QPoint(0, 0), size), mode, state);
+    return pixmap;
+}
+
+QIconEngine *KColorSchemePreviewEngine::clone() const
+{
+    return new KColorSchemePreviewEngine(m_colors);
+}
+
+QString KColorSchemePreviewEngine::key() const
+{
+    return QStringLiteral("KColorSchemePreviewEngine");
+}
+
+namespace
+{
+// "KCSP", followed by the format version. Bump the version whenever the layout changes.
+constexpr quint32 s_cacheMagic = 0x4B435350;
+constexpr quint32 s_cacheVersion = 1;
+constexpr QDataStream::Version s_streamVersion = QDataStream::Qt_6_5;
+}
+
+QHash<QString, PreviewCache::Entry> PreviewCache::load()
+{
+    QFile file(filePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    QDataStream stream(&file);
+    stream.setVersion(s_streamVersion);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    stream >> magic >> version >> count;
+    if (magic != s_cacheMagic || version != s_cacheVersion) {
+        return {};
+    }
+
+    QHash<QString, Entry> entries;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString path;
+        Entry entry;
+        stream >> path >> entry.modified >> entry.contentHash;
+        for (QRgb &color : entry.colors) {
+            stream >> color;
+        }
+        entries.insert(path, entry);
+    }
+    if (stream.status() != QDataStream::Ok) {
+        qCDebug(KCOLORSCHEME) << "Ignoring corrupt color scheme preview cache" << file.fileName();
+        return {};
+    }
+    return entries;
+}
+
+void PreviewCache::store(const QHash<QString, Entry> &entries)
+{
+    const QString path = filePath();
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        return;
+    }
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(s_streamVersion);
+    stream << s_cacheMagic << s_cacheVersion << quint32(entries.size());
+    for (auto it = entries.cbegin(); it != entries.cend(); ++it) {
+        stream << it.key() << it->modified << it->contentHash;
+        for (QRgb color : it->colors) {
+            stream << color;
+        }
+    }
+    if (!file.commit()) {
+        qCDebug(KCOLORSCHEME) << "Could not write color scheme preview cache" << path << file.errorString();
+    }
+}
+
+QByteArray PreviewCache::contentHash(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&file);
+    return hash.result();
+}
+
+QString PreviewCache::filePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kcolorscheme/previews.cache");
+}
@@ -0,0 +1,68 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KCOLORSCHEMEPREVIEW_P_H
+#define KCOLORSCHEMEPREVIEW_P_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QIconEngine>
+#include <QRgb>
+
+#include <array>
+#include <optional>
+
+/*
+ * The icon previewing a color scheme in KColorSchemeModel: the backgrounds of
+ * its Window, Button, View and Selection sets in four squares. Only the colors
+ * are kept, the icon is painted at whatever size and scale it is asked for.
+ * Without colors, it's a blank placeholder.
+ */
+class KColorSchemePreviewEngine : public QIconEngine
+{
+public:
+    // Window, Button, View and Selection backgrounds, in that order
+    using Colors = std::array<QRgb, 4>;
+
+    explicit KColorSchemePreviewEngine(const std::optional<Colors> &colors = std::nullopt);
+
+    void paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state) override;
+    QPixmap pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state) override;
+    QPixmap scaledPixmap(const QSize &size, QIcon::Mode mode, QIcon::State state, qreal scale) override;
+    QIconEngine *clone() const override;
+    QString key() const override;
+
+private:
+    const std::optional<Colors> m_colors;
+};
+
+/*
+ * The colors of previews, stored in the cache directory so that a new process
+ * doesn't need to read schemes to show their previews. They don't depend on
+ * the size the previews get painted at.
+ */
+namespace PreviewCache
+{
+struct Entry {
+    // Of the scheme file when the colors were read
+    qint64 modified = 0;
+    QByteArray contentHash;
+    KColorSchemePreviewEngine::Colors colors{};
+};
+
+// The stored previews, by path of their scheme
+QHash<QString, Entry> load();
+
+void store(const QHash<QString, Entry> &entries);
+
+// Identifies the contents of the scheme at path, empty if it can't be read
+QByteArray contentHash(const QString &path);
+
+QString filePath();
+}
+
+#endif
@@ -0,0 +1,382 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "kcolorschemescanner_p.h"
+
+#include "kcolorscheme_debug.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QLocale>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QTimeZone>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <utility>
+
+// Undoes the escaping KConfig applies to values when writing them
+static QString unescape(QByteArrayView value)
+{
+    if (!value.contains('\\')) {
+        return QString::fromUtf8(value);
+    }
+
+    QByteArray result;
+    result.reserve(value.size());
+    for (qsizetype i = 0; i < value.size(); ++i) {
+        const char c = value[i];
+        if (c != '\\' || i + 1 == value.size()) {
+            result += c;
+            continue;
+        }
+        switch (value[++i]) {
+        case 's':
+            result += ' ';
+            break;
+        case 't':
+            result += '\t';
+            break;
+        case 'n':
+            result += '\n';
+            break;
+        case 'r':
+            result += '\r';
+            break;
+        case 'x': {
+            bool ok = false;
+            const char byte = char(value.sliced(i + 1, std::min<qsizetype>(2, value.size() - i - 1)).toUInt(&ok, 16));
+            if (ok) {
+                result += byte;
+                i += 2;
+            } else {
+                result += "\\x";
+            }
+            break;
+        }
+        default:
+            result += value[i];
+            break;
+        }
+    }
+    return QString::fromUtf8(result);
+}
+
+QString SchemeScanner::readName(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+
+    // Prefer the name for the exact locale, then the one for its language
+    const QByteArray locale = QLocale().name().toUtf8();
+    const qsizetype territory = locale.indexOf('_');
+    const QByteArrayView language = territory > 0 ? QByteArrayView(locale).first(territory) : QByteArrayView(locale);
+
+    QString name;
+    QString languageName;
+    QString localeName;
+    bool inGeneral = false;
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        if (line.startsWith('[')) {
+            if (inGeneral) {
+                // Everything we need is in [General], skip the rest of the file
+                break;
+            }
+            inGeneral = line == "[General]";
+            continue;
+        }
+        if (!inGeneral) {
+            continue;
+        }
+
+        const qsizetype separator = line.indexOf('=');
+        if (separator < 0) {
+            continue;
+        }
+        QByteArrayView key = QByteArrayView(line).first(separator).trimmed();
+        if (!key.startsWith("Name")) {
+            continue;
+        }
+        key = key.sliced(4);
+        // Options like [$i] don't change the value
+        if (const qsizetype options = key.indexOf("[$"); options >= 0) {
+            key = key.first(options);
+        }
+
+        const QString value = unescape(QByteArrayView(line).sliced(separator + 1).trimmed());
+        if (key.isEmpty()) {
+            name = value;
+        } else if (key.size() > 2 && key.front() == '[' && key.back() == ']') {
+            const QByteArrayView keyLocale = key.sliced(1, key.size() - 2);
+            if (keyLocale == locale) {
+                localeName = value;
+            } else if (keyLocale == language) {
+                languageName = value;
+            }
+        }
+    }
+
+    if (!localeName.isEmpty()) {
+        return localeName;
+    }
+    if (!languageName.isEmpty()) {
+        return languageName;
+    }
+    return name.isEmpty() ? QString() : name;
+}
+
+namespace SchemeScanner
+{
+QDataStream &operator<<(QDataStream &stream, const SchemeFile &file)
+{
+    return stream << file.fileName << file.name << file.modified;
+}
+
+QDataStream &operator>>(QDataStream &stream, SchemeFile &file)
+{
+    return stream >> file.fileName >> file.name >> file.modified;
+}
+
+QDataStream &operator<<(QDataStream &stream, const SchemeDirectory &dir)
+{
+    return stream << dir.path << dir.modified << dir.scanned << dir.files;
+}
+
+QDataStream &operator>>(QDataStream &stream, SchemeDirectory &dir)
+{
+    return stream >> dir.path >> dir.modified >> dir.scanned >> dir.files;
+}
+}
+
+namespace
+{
+// "KCSI", followed by the format version. Bump the version whenever the layout changes.
+constexpr quint32 s_indexMagic = 0x4B435349;
+constexpr quint32 s_indexVersion = 2;
+constexpr QDataStream::Version s_streamVersion = QDataStream::Qt_6_5;
+
+qint64 modificationTime(const QFileInfo &info)
+{
+    return info.lastModified(QTimeZone::UTC).toMSecsSinceEpoch();
+}
+
+// How long something may still be changing after it was modified without its modification
+// time changing, within the resolution of the file system
+constexpr qint64 s_settleTime = 2000;
+
+// Bundled schemes can't change, and listing them is cheap
+bool isIndexable(const QString &dir)
+{
+    return !dir.startsWith(QLatin1Char(':')) && !dir.startsWith(QLatin1String("assets:"));
+}
+
+QHash<QString, SchemeScanner::SchemeDirectory> readIndex()
+{
+    QFile file(SchemeScanner::indexFilePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    QDataStream stream(&file);
+    stream.setVersion(s_streamVersion);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != s_indexMagic || version != s_indexVersion) {
+        return {};
+    }
+    QList<SchemeScanner::SchemeDirectory> dirs;
+    stream >> dirs;
+    if (stream.status() != QDataStream::Ok) {
+        qCDebug(KCOLORSCHEME) << "Ignoring corrupt color scheme index" << file.fileName();
+        return {};
+    }
+
+    QHash<QString, SchemeScanner::SchemeDirectory> index;
+    for (auto &dir : dirs) {
+        index.insert(dir.path, std::move(dir));
+    }
+    return index;
+}
+
+void writeIndex(const QList<SchemeScanner::SchemeDirectory> &dirs)
+{
+    const QString path = SchemeScanner::indexFilePath();
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        return;
+    }
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(s_streamVersion);
+    stream << s_indexMagic << s_indexVersion;
+
+    QList<SchemeScanner::SchemeDirectory> indexable;
+    std::copy_if(dirs.cbegin(), dirs.cend(), std::back_inserter(indexable), [](const SchemeScanner::SchemeDirectory &dir) {
+        return isIndexable(dir.path);
+    });
+    stream << indexable;
+    if (!file.commit()) {
+        qCDebug(KCOLORSCHEME) << "Could not write color scheme index" << path << file.errorString();
+    }
+}
+
+// Lists path, taking the names of files that didn't change since previous was
+// scanned from it. The files whose names still need to be read are added to unread.
+SchemeScanner::SchemeDirectory scanDirectory(const QString &path, const SchemeScanner::SchemeDirectory *previous, QList<qsizetype> &unread)
+{
+    SchemeScanner::SchemeDirectory dir{path, -1, QDateTime::currentMSecsSinceEpoch(), {}};
+    if (isIndexable(path)) {
+        // A directory modified just now may still be changing after it was listed, don't trust it yet
+        const qint64 modified = modificationTime(QFileInfo(path));
+        if (modified < dir.scanned - s_settleTime) {
+            dir.modified = modified;
+        }
+    }
+
+    QHash<QString, const SchemeScanner::SchemeFile *> known;
+    if (previous) {
+        for (const auto &file : previous->files) {
+            known.insert(file.fileName, &file);
+        }
+    }
+
+    const QFileInfoList entries = QDir(path).entryInfoList({QStringLiteral("*.colors")});
+    dir.files.reserve(entries.size());
+    for (const QFileInfo &entry : entries) {
+        SchemeScanner::SchemeFile file{entry.fileName(), QString(), modificationTime(entry)};
+        const SchemeScanner::SchemeFile *knownFile = known.value(file.fileName);
+        if (knownFile && knownFile->modified == file.modified && knownFile->modified < previous->scanned - s_settleTime) {
+            file.name = knownFile->name;
+        } else {
+            unread.append(dir.files.size());
+        }
+        dir.files.append(std::move(file));
+    }
+    return dir;
+}
+
+// Whether none of the files of dir changed since it was scanned, the same goes for
+// files modified just before, they may have changed after they were read
+bool filesUnchanged(const SchemeScanner::SchemeDirectory &dir)
+{
+    const QDir directory(dir.path);
+    return std::all_of(dir.files.cbegin(), dir.files.cend(), [&dir, &directory](const SchemeScanner::SchemeFile &file) {
+        return file.modified < dir.scanned - s_settleTime && file.modified == modificationTime(QFileInfo(directory.filePath(file.fileName)));
+    });
+}
+
+// Below this, waking up other threads costs more than it saves
+constexpr qsizetype s_minParallelReads = 32;
+
+// Reads the names of all files at paths, spread across the global thread pool
+QStringList readNames(const QStringList &paths)
+{
+    QStringList names(paths.size());
+    QString *const results = names.data();
+    std::atomic<qsizetype> next = 0;
+    const auto readRemaining = [&paths, results, &next] {
+        for (qsizetype i = next.fetch_add(1, std::memory_order_relaxed); i < paths.size(); i = next.fetch_add(1, std::memory_order_relaxed)) {
+            results[i] = SchemeScanner::readName(paths[i]);
+        }
+    };
+
+    // The calling thread reads as well, so it doesn't matter if the pool is busy
+    QSemaphore finished;
+    int helpers = 0;
+    if (paths.size() >= s_minParallelReads) {
+        QThreadPool *pool = QThreadPool::globalInstance();
+        for (int i = 1; i < pool->maxThreadCount(); ++i) {
+            const bool started = pool->tryStart([&readRemaining, &finished] {
+                readRemaining();
+                finished.release();
+            });
+            if (!started) {
+                break;
+            }
+            ++helpers;
+        }
+    }
+    readRemaining();
+    finished.acquire(helpers);
+    return names;
+}
+}
+
+QString SchemeScanner::indexFilePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kcolorscheme/schemes_") + QLocale().name()
+        + QStringLiteral(".index");
+}
+
+QList<SchemeScanner::SchemeDirectory> SchemeScanner::scan(const QStringList &dirs)
+{
+    const auto index = readIndex();
+
+    QList<SchemeDirectory> result;
+    result.reserve(dirs.size());
+    // Files whose names need to be read, as indexes into result and the files of a directory
+    QList<std::pair<qsizetype, qsizetype>> unread;
+    QStringList unreadPaths;
+    const auto addDirectory = [&result, &unread, &unreadPaths](SchemeDirectory &&dir, const QList<qsizetype> &unreadFiles) {
+        for (const qsizetype file : unreadFiles) {
+            unread.append({result.size(), file});
+            unreadPaths.append(QDir(dir.path).filePath(dir.files[file].fileName));
+        }
+        result.append(std::move(dir));
+    };
+
+    bool changed = false;
+    qsizetype indexable = 0;
+    for (const QString &path : dirs) {
+        QList<qsizetype> unreadFiles;
+        if (!isIndexable(path)) {
+            addDirectory(scanDirectory(path, nullptr, unreadFiles), unreadFiles);
+            continue;
+        }
+        ++indexable;
+
+        // Adding, removing or replacing a file modifies the directory. Files edited
+        // in place don't, so those of the index are checked as well, which is still
+        // far cheaper than reading them.
+        const auto it = index.constFind(path);
+        if (it != index.cend() && it->modified >= 0 && it->modified == modificationTime(QFileInfo(path)) && filesUnchanged(*it)) {
+            result.append(*it);
+            continue;
+        }
+        addDirectory(scanDirectory(path, it != index.cend() ? &*it : nullptr, unreadFiles), unreadFiles);
+        changed = true;
+    }
+
+    // Reading the files dominates a scan, and the order they are read in doesn't matter
+    const QStringList names = readNames(unreadPaths);
+    for (qsizetype i = 0; i < unread.size(); ++i) {
+        const auto [dir, file] = unread[i];
+        result[dir].files[file].name = names[i];
+    }
+
+    if (changed || index.size() != indexable) {
+        writeIndex(result);
+    }
+    return result;
+}
@@ -0,0 +1,57 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KCOLORSCHEMESCANNER_P_H
+#define KCOLORSCHEMESCANNER_P_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/*
+ * Finds .colors files and reads their metadata for KColorSchemeModel without
+ * going through KConfig. Only the [General] group of a file is looked at, the
+ * file is not read any further once it ended.
+ */
+namespace SchemeScanner
+{
+/*
+ * The name of the scheme at path in the current locale, like
+ * KConfigGroup(config, "General").readEntry("Name") would return it.
+ * Null if the file can't be read or has no name.
+ */
+QString readName(const QString &path);
+
+// A .colors file found by scan()
+struct SchemeFile {
+    QString fileName;
+    // In the current locale, null if the file has none
+    QString name;
+    qint64 modified = 0;
+};
+
+struct SchemeDirectory {
+    QString path;
+    // -1 if it is not known, the directory is always listed again then
+    qint64 modified = -1;
+    // When it was listed, files modified shortly before are read again
+    qint64 scanned = 0;
+    QList<SchemeFile> files;
+};
+
+/*
+ * The schemes in each of dirs. Directories that were not modified since
+ * the last scan, and none of whose files were, are taken from an index in
+ * the cache directory, without listing them or reading any of their files.
+ */
+QList<SchemeDirectory> scan(const QStringList &dirs);
+
+// The index scan() uses, names in it are for the current locale
+QString indexFilePath();
+}
+
+#endif
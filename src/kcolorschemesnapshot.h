@@ -0,0 +1,78 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KCOLORSCHEMESNAPSHOT_H
+#define KCOLORSCHEMESNAPSHOT_H
+
+#include "kcolorscheme.h"
+
+#include <memory>
+
+class KColorSchemeSnapshotPrivate;
+
+/*!
+ * \class KColorSchemeSnapshot
+ * \inmodule KColorScheme
+ *
+ * \brief The application's color scheme, frozen at one point in time.
+ *
+ * A snapshot holds every color set and state of the application's color
+ * scheme, resolved completely, as it was when the snapshot was taken. It never
+ * changes afterwards, so a render thread can take one at the start of a frame
+ * and draw the whole frame with it, even if the scheme gets switched meanwhile.
+ *
+ * Whenever the application's scheme changes, e.g. because KColorSchemeManager
+ * activates another one, a new snapshot is published for all threads. Taking
+ * the current snapshot is safe from any thread, and only takes a lock the
+ * first time a thread asks for it after a change.
+ *
+ * \code
+ * const auto snapshot = KColorSchemeSnapshot::current();
+ * const KColorScheme view = snapshot.scheme(QPalette::Active, KColorScheme::View);
+ * const KColorScheme selection = snapshot.scheme(QPalette::Active, KColorScheme::Selection);
+ * \endcode
+ *
+ * \since 6.29
+ */
+class KCOLORSCHEME_EXPORT KColorSchemeSnapshot
+{
+public:
+    KColorSchemeSnapshot(const KColorSchemeSnapshot &);
+    KColorSchemeSnapshot &operator=(const KColorSchemeSnapshot &);
+    KColorSchemeSnapshot(KColorSchemeSnapshot &&);
+    KColorSchemeSnapshot &operator=(KColorSchemeSnapshot &&);
+    ~KColorSchemeSnapshot();
+
+    /*!
+     * Returns the snapshot of the application's current color scheme.
+     */
+    static KColorSchemeSnapshot current();
+
+    /*!
+     * Returns the KColorScheme::generation() this snapshot was taken at.
+     */
+    quint64 generation() const;
+
+    /*!
+     * Returns whether this is still the current snapshot. If not, the
+     * application's color scheme may have changed since it was taken.
+     */
+    bool isCurrent() const;
+
+    /*!
+     * Returns the colors of the given state and set, as KColorScheme(state, set)
+     * returned them when this snapshot was taken.
+     */
+    KColorScheme scheme(QPalette::ColorGroup state = QPalette::Normal, KColorScheme::ColorSet set = KColorScheme::View) const;
+
+private:
+    explicit KColorSchemeSnapshot(std::shared_ptr<const KColorSchemeSnapshotPrivate> &&d);
+
+    std::shared_ptr<const KColorSchemeSnapshotPrivate> d;
+};
+
+#endif
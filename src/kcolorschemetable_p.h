@@ -0,0 +1,147 @@
+/*
+    This file is part of the KDE project
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KCOLORSCHEMETABLE_P_H
+#define KCOLORSCHEMETABLE_P_H
+
+#include <KConfigGroup>
+
+#include <QColor>
+#include <QtGlobal>
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+/*
+ * Layout of the tables kcolorscheme_compiler generates from .colors files.
+ * Shared between the compiler and the library, which finds them in the
+ * application's resources and decodes them in CompiledScheme::fromTable().
+ * Change Magic whenever the layout changes.
+ *
+ * A table is a flat array of little-endian quint64:
+ * - Magic
+ * - for every color set, in KColorScheme::ColorSet order, its Colors:* group
+ *   followed by its [Inactive] subgroup, each being a mask word and one value
+ *   per entry of colorKeys
+ * - ColorEffects:Inactive and ColorEffects:Disabled, each a mask word and one
+ *   value per entry of effectKeys
+ * - KDE, a mask word and the contrast
+ *
+ * Bit i of a mask word is set if the group has entry i, bit 32 + i if it has
+ * it but its value is an invalid color, see readColor(). Malformed entries
+ * are left out like missing ones. GroupExists is set for existing
+ * groups. Colors are QRgba64, doubles are stored bitwise.
+ */
+namespace SchemeTable
+{
+// Tables are resources named after the hex SHA-1 of the path their scheme is opened from
+constexpr char ResourceDirectory[] = ":/kcolorscheme-tables/";
+
+constexpr quint64 Magic = 0x4B4353540001; // "KCST", version 1
+constexpr quint64 GroupExists = quint64(1) << 63;
+constexpr int InvalidShift = 32;
+
+// clang-format off
+constexpr std::array<std::string_view, 7> colorSetGroups = {
+    "Colors:View",
+    "Colors:Window",
+    "Colors:Button",
+    "Colors:Selection",
+    "Colors:Tooltip",
+    "Colors:Complementary",
+    "Colors:Header",
+};
+
+// The colors of a group, in ColorGroupEntries order
+constexpr std::array<std::string_view, 12> colorKeys = {
+    "ForegroundNormal",
+    "ForegroundInactive",
+    "ForegroundActive",
+    "ForegroundLink",
+    "ForegroundVisited",
+    "ForegroundNegative",
+    "ForegroundNeutral",
+    "ForegroundPositive",
+    "BackgroundNormal",
+    "BackgroundAlternate",
+    "DecorationFocus",
+    "DecorationHover",
+};
+
+enum class EntryType {
+    Bool,
+    Int,
+    Double,
+    Color,
+};
+
+constexpr std::array<std::pair<std::string_view, EntryType>, 9> effectKeys = {{
+    {"Enable", EntryType::Bool},
+    {"ChangeSelectionColor", EntryType::Bool},
+    {"IntensityEffect", EntryType::Int},
+    {"IntensityAmount", EntryType::Double},
+    {"ColorEffect", EntryType::Int},
+    {"ColorAmount", EntryType::Double},
+    {"Color", EntryType::Color},
+    {"ContrastEffect", EntryType::Int},
+    {"ContrastAmount", EntryType::Double},
+}};
+// clang-format on
+
+constexpr std::array<std::string_view, 2> effectGroups = {"ColorEffects:Inactive", "ColorEffects:Disabled"};
+
+constexpr std::size_t colorGroupSize = 1 + colorKeys.size();
+constexpr std::size_t effectGroupSize = 1 + effectKeys.size();
+
+constexpr std::size_t colorGroupOffset(std::size_t set, bool inactive)
+{
+    return 1 + (2 * set + (inactive ? 1 : 0)) * colorGroupSize;
+}
+
+// index 0 is ColorEffects:Inactive, 1 is ColorEffects:Disabled
+constexpr std::size_t effectGroupOffset(std::size_t index)
+{
+    return colorGroupOffset(colorSetGroups.size(), false) + index * effectGroupSize;
+}
+
+constexpr std::size_t contrastOffset = effectGroupOffset(effectGroups.size());
+constexpr std::size_t size = contrastOffset + 2;
+
+constexpr std::size_t effectKeyIndex(std::string_view key)
+{
+    for (std::size_t i = 0; i < effectKeys.size(); ++i) {
+        if (effectKeys[i].first == key) {
+            return i;
+        }
+    }
+    return effectKeys.size();
+}
+
+/*
+ * Reads the color of a Colors:* entry as readEntry(key, defaultValue) would,
+ * whatever the default of the set is: nothing if the entry is missing or
+ * malformed, so that the default applies, otherwise its color, which is
+ * invalid for entries like "invalid".
+ */
+inline std::optional<QColor> readColor(const KConfigGroup &group, const char *key)
+{
+    if (!group.hasKey(key)) {
+        return std::nullopt;
+    }
+    // A malformed entry reads as the default passed, whichever that is
+    const QColor color = group.readEntry(key, QColor(Qt::black));
+    if (color == QColor(Qt::black) && group.readEntry(key, QColor(Qt::white)) == QColor(Qt::white)) {
+        return std::nullopt;
+    }
+    return color;
+}
+}
+
+#endif
@@ -55,8 +55,8 @@ KStatefulBrush::KStatefulBrush(const QBrush &brush, KSharedConfigPtr config)
         config = defaultConfig();
     }
     d->brushes[QPalette::Active] = brush;
-    d->brushes[QPalette::Disabled] = StateEffects(QPalette::Disabled, config).brush(brush);
-    d->brushes[QPalette::Inactive] = StateEffects(QPalette::Inactive, config).brush(brush);
+    d->brushes[QPalette::Disabled] = StateEffects::forConfig(QPalette::Disabled, config)->brush(brush);
+    d->brushes[QPalette::Inactive] = StateEffects::forConfig(QPalette::Inactive, config)->brush(brush);
 }
 
 KStatefulBrush::KStatefulBrush(const QBrush &brush, const QBrush &background, KSharedConfigPtr config)
@@ -66,8 +66,8 @@ KStatefulBrush::KStatefulBrush(const QBrush &brush, const QBrush &background, KS
         config = defaultConfig();
     }
     d->brushes[QPalette::Active] = brush;
-    d->brushes[QPalette::Disabled] = StateEffects(QPalette::Disabled, config).brush(brush, background);
-    d->brushes[QPalette::Inactive] = StateEffects(QPalette::Inactive, config).brush(brush, background);
+    d->brushes[QPalette::Disabled] = StateEffects::forConfig(QPalette::Disabled, config)->brush(brush, background);
+    d->brushes[QPalette::Inactive] = StateEffects::forConfig(QPalette::Inactive, config)->brush(brush, background);
 }
 
 KStatefulBrush::KStatefulBrush(const KStatefulBrush &other)